@@ -33,11 +33,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <stdint.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <net/if.h>
 
 #define MAGIC { 0xB0, 0x07, 0xB0, 0x07 }
 #define ETHER_PROTOCOL 0x88B6
 #define MAX_CLIENTS 10
 
+// Protocol version 2, see unbs.c for the layout
+#define PROTOCOL_VERSION 2
+#define PROTOCOL_FLAG_REPLY 0x01
+#define PROTOCOL_ATTEMPT_MASK 0xF0
+#define V2_PACKET_SIZE 14
+
 typedef struct clients_tt
 {
   uint8_t address[6];
@@ -47,15 +55,70 @@ typedef struct clients_tt
 clients_t clients[MAX_CLIENTS];
 uint8_t numClients;
 
+// Last v2 reply sent to each client. A retransmit of the same request (same
+// request ID, next attempt number) is answered from here, not looked up again.
+typedef struct reply_cache_tt
+{
+  uint8_t address[6];
+  uint32_t requestId;
+  uint16_t bytes;
+  char valid;
+} reply_cache_t;
+
+reply_cache_t replyCache[MAX_CLIENTS];
+uint8_t nextCacheSlot;
+
 void sendPacket(int fd, int ifindex, uint8_t* to, uint8_t* buffer, ssize_t length);
 void handleSignal(int sigNum);
 int readDB();
+void followDB();
+int joinMulticast(int fd, uint8_t* group);
+uint16_t lookupClient(uint8_t* address);
+reply_cache_t* findCachedReply(uint8_t* address);
 
 char reReadDB = 0;
 
-int main()
+/*
+ * Several servers can be listed in a client's server.mac. Run each one with
+ * -f on the same (shared or synced) unbs-server.db so that whichever answers
+ * first gives the same answer: the DB is re-read as soon as it changes,
+ * without waiting for SIGUSR1. -m joins a multicast group on every interface
+ * so clients can list that group instead of, or as well as, the servers.
+ */
+
+char followDBFile = 0;
+struct timespec dbModified;
+
+int main(int argc, char** argv)
 {
   const uint8_t magicBytes[4] = MAGIC;
+  uint8_t multicastGroup[6];
+  char useMulticast = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "fm:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'f':
+        followDBFile = 1;
+        break;
+      case 'm':
+        if (sscanf(optarg, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &multicastGroup[0], &multicastGroup[1],
+                   &multicastGroup[2], &multicastGroup[3], &multicastGroup[4], &multicastGroup[5]) != 6)
+        {
+          printf("Bad multicast address: %s\n", optarg);
+          exit(-1);
+        }
+        useMulticast = 1;
+        break;
+      default:
+        printf("Usage: %s [-f] [-m multicast-mac]\n", argv[0]);
+        printf("  -f  Re-read unbs-server.db whenever it changes\n");
+        printf("  -m  Also listen on this multicast MAC address\n");
+        exit(-1);
+    }
+  }
 
   pid_t myPid = getpid();
   FILE* pidFile = fopen("unbs-server.pid", "w");
@@ -76,7 +139,9 @@ int main()
     perror("SOCKET");
     exit(-1);
   }
- 
+
+  if (useMulticast && !joinMulticast(fd, multicastGroup)) exit(-1);
+
   // Make loop variables
 
   const int bufferSize = 100;
@@ -104,12 +169,16 @@ int main()
       continue;
     }
 
+    if (srcAddr.sll_pkttype == PACKET_OUTGOING) continue; // Our own replies
+
     if (srcAddr.sll_halen != 6)
     {
       printf("Error: Address length isn't 6.\n");
       continue;
     }
 
+    if (followDBFile) followDB();
+
     printf("Received %i byte packet on interface %d from %x:%x:%x:%x:%x:%x\n",
            got, srcAddr.sll_ifindex, srcAddr.sll_addr[0], srcAddr.sll_addr[1],
            srcAddr.sll_addr[2], srcAddr.sll_addr[3], srcAddr.sll_addr[4], srcAddr.sll_addr[5]);
@@ -126,36 +195,53 @@ int main()
       continue;
     }
 
-    memset(buffer, 0, bufferSize);
-    memcpy(buffer, magicBytes, 4);
-
-    int i;
-    for(i = 0; i < numClients; i++)
+    if ((got >= V2_PACKET_SIZE) && (buffer[4] == PROTOCOL_VERSION))
     {
-      printf("%x %x %x %x %x %x\n", 
-        clients[i].address[0],
-        clients[i].address[1],
-        clients[i].address[2],
-        clients[i].address[3],
-        clients[i].address[4],
-        clients[i].address[5]
-      );
-    
-    
-      if (!memcmp(clients[i].address, srcAddr.sll_addr, 6))
+      if (buffer[5] & PROTOCOL_FLAG_REPLY) continue;
+
+      uint32_t requestId = buffer[6] | (buffer[7] << 8) | (buffer[8] << 16) | ((uint32_t)buffer[9] << 24);
+      uint8_t attempt = buffer[5] & PROTOCOL_ATTEMPT_MASK;
+      uint16_t bytes;
+
+      reply_cache_t* cached = findCachedReply(srcAddr.sll_addr);
+      if (cached && (cached->requestId == requestId))
       {
-        // Found client
-        unsigned short* target = (unsigned short*)&buffer[4];
-        *target = clients[i].bytes;
-        sendPacket(fd, srcAddr.sll_ifindex, srcAddr.sll_addr, buffer, 6);
-        break;
+        printf("Request %x attempt %d is a retransmit, replying from cache\n", requestId, buffer[5] >> 4);
+        bytes = cached->bytes;
+      }
+      else
+      {
+        bytes = lookupClient(srcAddr.sll_addr);
+        if (!cached)
+        {
+          cached = &replyCache[nextCacheSlot];
+          nextCacheSlot = (nextCacheSlot + 1) % MAX_CLIENTS;
+          memcpy(cached->address, srcAddr.sll_addr, 6);
+          cached->valid = 1;
+        }
+        cached->requestId = requestId;
+        cached->bytes = bytes;
       }
-    }
 
-    if (i == numClients) // Not found - reply with fail code
+      memset(buffer, 0, bufferSize);
+      memcpy(buffer, magicBytes, 4);
+      buffer[4] = PROTOCOL_VERSION;
+      buffer[5] = PROTOCOL_FLAG_REPLY | attempt;
+      buffer[6] = requestId & 0xFF;
+      buffer[7] = (requestId >> 8) & 0xFF;
+      buffer[8] = (requestId >> 16) & 0xFF;
+      buffer[9] = (requestId >> 24) & 0xFF;
+      buffer[10] = bytes & 0xFF;
+      buffer[11] = bytes >> 8;
+      // buffer[12-13] Load options length, 0
+      sendPacket(fd, srcAddr.sll_ifindex, srcAddr.sll_addr, buffer, V2_PACKET_SIZE);
+    }
+    else // Version 1
     {
+      memset(buffer, 0, bufferSize);
+      memcpy(buffer, magicBytes, 4);
       unsigned short* target = (unsigned short*)&buffer[4];
-      *target = 0xFFFF;
+      *target = lookupClient(srcAddr.sll_addr); // 0xFFFF if not found
       sendPacket(fd, srcAddr.sll_ifindex, srcAddr.sll_addr, buffer, 6);
     }
   }
@@ -180,6 +266,76 @@ void sendPacket(int fd, int ifindex, uint8_t* to, uint8_t* buffer, ssize_t lengt
   }
 }
 
+int joinMulticast(int fd, uint8_t* group)
+{
+  struct if_nameindex* interfaces = if_nameindex();
+  if (!interfaces)
+  {
+    perror("IF_NAMEINDEX");
+    return 0;
+  }
+
+  int joined = 0;
+  for (struct if_nameindex* i = interfaces; i->if_index; i++)
+  {
+    struct packet_mreq mreq;
+    memset(&mreq, 0, sizeof(struct packet_mreq));
+    mreq.mr_ifindex = i->if_index;
+    mreq.mr_type = PACKET_MR_MULTICAST;
+    mreq.mr_alen = ETH_ALEN;
+    memcpy(mreq.mr_address, group, 6);
+    if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(struct packet_mreq)) == 0)
+      joined++;
+    else
+      printf("Could not join multicast group on %s: %s\n", i->if_name, strerror(errno));
+  }
+  if_freenameindex(interfaces);
+
+  printf("Joined multicast group %x:%x:%x:%x:%x:%x on %d interface(s)\n",
+         group[0], group[1], group[2], group[3], group[4], group[5], joined);
+  return joined > 0;
+}
+
+void followDB()
+{
+  struct stat dbStat;
+  if (stat("unbs-server.db", &dbStat)) return; // Keep what we have
+
+  if (   (dbStat.st_mtim.tv_sec == dbModified.tv_sec)
+      && (dbStat.st_mtim.tv_nsec == dbModified.tv_nsec)) return;
+
+  printf("unbs-server.db changed\n");
+  readDB();
+}
+
+uint16_t lookupClient(uint8_t* address)
+{
+  for(int i = 0; i < numClients; i++)
+  {
+    printf("%x %x %x %x %x %x\n",
+      clients[i].address[0],
+      clients[i].address[1],
+      clients[i].address[2],
+      clients[i].address[3],
+      clients[i].address[4],
+      clients[i].address[5]
+    );
+
+    if (!memcmp(clients[i].address, address, 6)) return clients[i].bytes;
+  }
+
+  return 0xFFFF; // Not found - fail code
+}
+
+reply_cache_t* findCachedReply(uint8_t* address)
+{
+  for(int i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (replyCache[i].valid && !memcmp(replyCache[i].address, address, 6)) return &replyCache[i];
+  }
+  return NULL;
+}
+
 void handleSignal(int sigNum)
 {
   reReadDB = 1;
@@ -190,8 +346,11 @@ int readDB()
   char buffer[1024];
   uint8_t mac[6];
   uint16_t bytes;
+  struct stat dbStat;
+  if (!stat("unbs-server.db", &dbStat)) dbModified = dbStat.st_mtim;
   FILE* dbFile = fopen("unbs-server.db", "r");
   if (!dbFile) return 0;
+  memset(replyCache, 0, sizeof(replyCache)); // Answers may have changed
   int r;
   numClients = 0;
   for (int i = 0; i < MAX_CLIENTS; i++)
@@ -0,0 +1,239 @@
+/*
+
+UEFI Network Boot Switch - host build
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Runs efi_main() from unbs.c over and over against the mock firmware and
+ * a real unbs-server, then reports success rate and latencies.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "efilib.h"
+#include "mock.h"
+
+EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable);
+
+static void usage(const char* name)
+{
+  fprintf(stderr,
+    "Usage: %s -i interface -s server-macs [options]\n"
+    "  -i if      Interface for the simple network protocol (e.g. one end of a veth pair)\n"
+    "  -s macs    Server MACs, comma separated with the primary first, written to\n"
+    "             \\EFI\\UNBS\\server.mac on the mock ESP\n"
+    "  -n runs    Number of boots (default 100)\n"
+    "  -b list    Create Boot#### entries, comma separated hex (e.g. 0006,0012), and\n"
+    "             set BootOrder to them\n"
+    "  -e entry   Boot entry the server is expected to choose (hex)\n"
+    "  -l pct     Drop this percentage of transmitted and received frames\n"
+    "  -d ms      Delay received frames by this much\n"
+    "  -j ms      Add up to this much random delay to received frames\n"
+    "  -p us      Time taken by each SNP Receive poll\n"
+    "  -c us      Time taken per console character (115200 baud is about 87)\n"
+    "  -G us      Time taken by each GetVariable\n"
+    "  -L us      Time taken by each LoadImage\n"
+    "  -t scale   Make timer events fire this many times faster\n"
+    "  -E dir     Mock ESP directory (default esp)\n"
+    "  -V dir     Mock NVRAM variable directory (default vars)\n"
+    "  -S seed    Random seed for loss and jitter\n"
+    "  -v         Show console output\n", name);
+}
+
+static int compareDouble(const void* a, const void* b)
+{
+  double da = *(const double*)a;
+  double db = *(const double*)b;
+  return (da > db) - (da < db);
+}
+
+static void report(const char* title, double* values, int count)
+{
+  if (!count)
+  {
+    printf("%-26s no samples\n", title);
+    return;
+  }
+
+  qsort(values, count, sizeof(double), compareDouble);
+  double sum = 0;
+  for (int i = 0; i < count; i++) sum += values[i];
+
+  printf("%-26s min %8.2f  avg %8.2f  p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f ms\n", title,
+         values[0], sum / count, values[count / 2], values[(count * 90) / 100],
+         values[(count * 99) / 100], values[count - 1]);
+}
+
+static int writeServerMACs(const char* macs)
+{
+  char path[512];
+  snprintf(path, sizeof(path), "%s", mockConfig.espDir);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/EFI", mockConfig.espDir);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/EFI/UNBS", mockConfig.espDir);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/EFI/UNBS/server.mac", mockConfig.espDir);
+
+  FILE* macFile = fopen(path, "w");
+  if (!macFile) return 0;
+  for (const char* c = macs; *c; c++) fputc((*c == ',') ? '\n' : *c, macFile);
+  fputc('\n', macFile);
+  fclose(macFile);
+  return 1;
+}
+
+static int createEntries(char* list)
+{
+  UINT16 bootOrder[64];
+  UINTN count = 0;
+  for (char* item = strtok(list, ","); item && (count < 64); item = strtok(NULL, ","))
+  {
+    unsigned int number = strtoul(item, NULL, 16);
+    bootOrder[count++] = number;
+    char description[32];
+    char path[64];
+    snprintf(description, sizeof(description), "Mock %04X", number);
+    snprintf(path, sizeof(path), "\\EFI\\MOCK\\BOOT%04X.EFI", number);
+    if (!mockWriteLoadOption(number, description, path)) return 0;
+  }
+  return mockWriteBootOrder(bootOrder, count);
+}
+
+int main(int argc, char** argv)
+{
+  int runs = 100;
+  const char* serverMACs = NULL;
+  char* entries = NULL;
+  int expected = -1;
+  unsigned int seed = 1;
+
+  mockConfig.quiet = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:s:n:b:e:l:d:j:p:c:G:L:t:E:V:S:vh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'i': mockConfig.ifName = optarg; break;
+      case 's': serverMACs = optarg; break;
+      case 'n': runs = atoi(optarg); break;
+      case 'b': entries = optarg; break;
+      case 'e': expected = strtoul(optarg, NULL, 16); break;
+      case 'l': mockConfig.lossPercent = atoi(optarg); break;
+      case 'd': mockConfig.delayMs = atoi(optarg); break;
+      case 'j': mockConfig.jitterMs = atoi(optarg); break;
+      case 'p': mockConfig.pollCostUs = atoi(optarg); break;
+      case 'c': mockConfig.consoleCharUs = atoi(optarg); break;
+      case 'G': mockConfig.variableCostUs = atoi(optarg); break;
+      case 'L': mockConfig.loadCostUs = atoi(optarg); break;
+      case 't': mockConfig.timerScale = atoi(optarg); break;
+      case 'E': mockConfig.espDir = optarg; break;
+      case 'V': mockConfig.varDir = optarg; break;
+      case 'S': seed = atoi(optarg); break;
+      case 'v': mockConfig.quiet = 0; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (!mockConfig.ifName || !serverMACs || (runs < 1))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  srandom(seed);
+
+  if (!writeServerMACs(serverMACs))
+  {
+    perror("server.mac");
+    return 1;
+  }
+
+  if (entries && !createEntries(entries))
+  {
+    fprintf(stderr, "Could not create boot entries\n");
+    return 1;
+  }
+
+  if (!mockInit()) return 1;
+
+  char expectedFile[32];
+  if (expected >= 0) snprintf(expectedFile, sizeof(expectedFile), "BOOT%04X.EFI", expected);
+
+  double* replyMs = calloc(runs, sizeof(double));
+  double* decisionMs = calloc(runs, sizeof(double));
+  double* replyToStartMs = calloc(runs, sizeof(double));
+  double* startMs = calloc(runs, sizeof(double));
+  int replies = 0, successes = 0, wrongEntry = 0;
+  unsigned long transmits = 0, receiveCalls = 0, framesDropped = 0, loads = 0, unloads = 0;
+
+  for (int run = 0; run < runs; run++)
+  {
+    mockResetRun();
+    efi_main(mockImageHandle, &mockSystemTable);
+
+    transmits += mockRun.transmits;
+    receiveCalls += mockRun.receiveCalls;
+    framesDropped += mockRun.framesDropped;
+    loads += mockRun.loads;
+    unloads += mockRun.unloads;
+
+    if (mockRun.gotReply)
+      replyMs[replies++] = mockElapsedMs(&mockRun.firstTransmit, &mockRun.firstReply);
+
+    if (!mockRun.started) continue;
+
+    if ((expected >= 0) && !strstr(mockRun.startedPath, expectedFile))
+    {
+      wrongEntry++;
+      continue;
+    }
+
+    decisionMs[successes] = mockElapsedMs(&mockRun.firstTransmit, &mockRun.decision);
+    replyToStartMs[successes] = mockElapsedMs(&mockRun.decision, &mockRun.startImage);
+    startMs[successes] = mockElapsedMs(&mockRun.handOff, &mockRun.startImage);
+    successes++;
+  }
+
+  mockShutdown();
+
+  printf("Runs: %d  Success: %d (%.1f%%)  Wrong entry: %d  Got reply: %d\n",
+         runs, successes, (successes * 100.0) / runs, wrongEntry, replies);
+  printf("Per run: %.2f transmits, %.1f receive polls, %.2f image loads (%.2f unloaded). Frames dropped: %lu\n",
+         (double)transmits / runs, (double)receiveCalls / runs, (double)loads / runs, (double)unloads / runs,
+         framesDropped);
+  report("Request -> first reply", replyMs, replies);
+  report("Request -> decision", decisionMs, successes);
+  report("Reply -> StartImage", replyToStartMs, successes);
+  report("Hand-off -> StartImage", startMs, successes);
+  if (mockConfig.timerScale > 1)
+    printf("(Timer events scaled 1/%u; hand-off -> StartImage includes scaled sleeps)\n", mockConfig.timerScale);
+
+  free(replyMs);
+  free(decisionMs);
+  free(replyToStartMs);
+  free(startMs);
+  return (successes == runs) ? 0 : 2;
+}
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# Boot unbs-host repeatedly against unbs-server over a veth pair, with the
+# server in its own network namespace. Needs root.
+#
+# Arguments are passed on to unbs-host, e.g.
+#   host/bench.sh -n 2000 -l 5 -d 20 -j 10 -p 50 -t 100
+#
+# UNBS_ENTRY sets the boot entry the server hands out (default 0006).
+#
+# UNBS_SERVERS runs that many servers (default 1), each in its own namespace
+# and all bridged to the client, sharing one DB in follow mode (-f). They
+# are listed in server.mac in order, primary first. UNBS_DOWN leaves that
+# many of the first servers listed but not running, to time fail-over.
+# UNBS_MULTICAST puts the servers in a multicast group (e.g.
+# 03:00:00:b0:07:01) and lists it in server.mac after them.
+
+set -e
+
+HERE=$(cd "$(dirname "$0")/.." && pwd)
+CLIENT=$HERE/unbs-host
+SERVER=$HERE/../unbs-server/unbs-server
+ENTRY=${UNBS_ENTRY:-0006}
+SERVERS=${UNBS_SERVERS:-1}
+DOWN=${UNBS_DOWN:-0}
+NS=unbs-bench
+
+WORK=$(mktemp -d)
+SERVER_PIDS=
+
+cleanup()
+{
+  for pid in $SERVER_PIDS; do
+    kill "$pid" 2>/dev/null || true
+  done
+  for i in $(seq 1 "$SERVERS"); do
+    ip netns del $NS-$i 2>/dev/null || true
+  done
+  ip netns del $NS 2>/dev/null || true
+  ip link del unbs-client 2>/dev/null || true
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# Client veth into a namespace holding a bridge, one veth per server off it
+
+ip netns add $NS
+ip -n $NS link add unbs-br type bridge
+ip -n $NS link set unbs-br up
+ip link add unbs-client type veth peer name unbs-port0 netns $NS
+ip -n $NS link set unbs-port0 master unbs-br up
+ip link set unbs-client up
+
+for i in $(seq 1 "$SERVERS"); do
+  ip netns add $NS-$i
+  ip -n $NS link add unbs-port$i type veth peer name unbs-server netns $NS-$i
+  ip -n $NS link set unbs-port$i master unbs-br up
+  ip -n $NS-$i link set unbs-server up
+done
+
+# Frames are dropped until the link is really up
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  [ "$(cat /sys/class/net/unbs-client/operstate)" = up ] && break
+  sleep 0.5
+done
+
+CLIENT_MAC=$(ip link show unbs-client | awk '/link\/ether/ { print $2 }')
+
+printf 'Bench client\n%s\n%s\n' "$CLIENT_MAC" "$ENTRY" > "$WORK/unbs-server.db"
+
+SERVER_MACS=
+for i in $(seq 1 "$SERVERS"); do
+  MAC=$(ip -n $NS-$i link show unbs-server | awk '/link\/ether/ { print $2 }')
+  SERVER_MACS=${SERVER_MACS:+$SERVER_MACS,}$MAC
+  [ "$i" -le "$DOWN" ] && continue
+
+  mkdir "$WORK/server$i"
+  ln -s ../unbs-server.db "$WORK/server$i/unbs-server.db"
+  (cd "$WORK/server$i" && exec ip netns exec $NS-$i "$SERVER" -f ${UNBS_MULTICAST:+-m $UNBS_MULTICAST} > server.log) &
+  SERVER_PIDS="$SERVER_PIDS $!"
+done
+[ -n "$UNBS_MULTICAST" ] && SERVER_MACS=$SERVER_MACS,$UNBS_MULTICAST
+sleep 1
+
+"$CLIENT" -i unbs-client -s "$SERVER_MACS" -b "0001,$ENTRY" -e "$ENTRY" \
+          -E "$WORK/esp" -V "$WORK/vars" "$@"
@@ -0,0 +1,356 @@
+/*
+
+UEFI Network Boot Switch - host build
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Stand-in for the GNU-EFI <efi.h> so unbs.c can be compiled and run as a
+ * normal Linux program. Only the parts of the EFI API that unbs.c uses are
+ * declared here. Names and layouts follow GNU-EFI so unbs.c needs no changes.
+ */
+
+#ifndef UNBS_HOST_EFI_H
+#define UNBS_HOST_EFI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t   UINT8;
+typedef uint16_t  UINT16;
+typedef uint32_t  UINT32;
+typedef uint64_t  UINT64;
+typedef int64_t   INT64;
+typedef uint64_t  UINTN;
+typedef int64_t   INTN;
+typedef uint8_t   BOOLEAN;
+typedef uint16_t  CHAR16;
+typedef CHAR16    WCHAR;
+typedef char      CHAR8;
+typedef void      VOID;
+
+typedef UINTN     EFI_STATUS;
+typedef VOID*     EFI_HANDLE;
+typedef VOID*     EFI_EVENT;
+typedef UINT64    EFI_PHYSICAL_ADDRESS;
+
+#define EFIAPI
+#define IN
+#define OUT
+#define OPTIONAL
+
+#ifndef TRUE
+#define TRUE  ((BOOLEAN)1)
+#define FALSE ((BOOLEAN)0)
+#endif
+
+// Status codes
+
+#define EFI_ERROR_MASK            0x8000000000000000ULL
+#define EFIERR(a)                 (EFI_ERROR_MASK | (a))
+#define EFI_ERROR(a)              (((INTN)(a)) < 0)
+
+#define EFI_SUCCESS               0
+#define EFI_LOAD_ERROR            EFIERR(1)
+#define EFI_INVALID_PARAMETER     EFIERR(2)
+#define EFI_UNSUPPORTED           EFIERR(3)
+#define EFI_BAD_BUFFER_SIZE       EFIERR(4)
+#define EFI_BUFFER_TOO_SMALL      EFIERR(5)
+#define EFI_NOT_READY             EFIERR(6)
+#define EFI_DEVICE_ERROR          EFIERR(7)
+#define EFI_WRITE_PROTECTED       EFIERR(8)
+#define EFI_OUT_OF_RESOURCES      EFIERR(9)
+#define EFI_NOT_FOUND             EFIERR(14)
+#define EFI_TIMEOUT               EFIERR(18)
+#define EFI_NOT_STARTED           EFIERR(19)
+#define EFI_ALREADY_STARTED       EFIERR(20)
+#define EFI_ABORTED               EFIERR(21)
+#define EFI_SECURITY_VIOLATION    EFIERR(26)
+
+// Calling convention. Mirrors the GNU-EFI x86_64 wrapper: every argument is
+// widened to 64 bits and the function is called through a generic pointer.
+
+UINT64 efi_call0(void* func);
+UINT64 efi_call1(void* func, UINT64 a1);
+UINT64 efi_call2(void* func, UINT64 a1, UINT64 a2);
+UINT64 efi_call3(void* func, UINT64 a1, UINT64 a2, UINT64 a3);
+UINT64 efi_call4(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4);
+UINT64 efi_call5(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4, UINT64 a5);
+UINT64 efi_call6(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4, UINT64 a5, UINT64 a6);
+UINT64 efi_call7(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4, UINT64 a5, UINT64 a6, UINT64 a7);
+
+#define _cast64_efi_call0(f) \
+  efi_call0((void*)(f))
+#define _cast64_efi_call1(f,a1) \
+  efi_call1((void*)(f), (UINT64)(a1))
+#define _cast64_efi_call2(f,a1,a2) \
+  efi_call2((void*)(f), (UINT64)(a1), (UINT64)(a2))
+#define _cast64_efi_call3(f,a1,a2,a3) \
+  efi_call3((void*)(f), (UINT64)(a1), (UINT64)(a2), (UINT64)(a3))
+#define _cast64_efi_call4(f,a1,a2,a3,a4) \
+  efi_call4((void*)(f), (UINT64)(a1), (UINT64)(a2), (UINT64)(a3), (UINT64)(a4))
+#define _cast64_efi_call5(f,a1,a2,a3,a4,a5) \
+  efi_call5((void*)(f), (UINT64)(a1), (UINT64)(a2), (UINT64)(a3), (UINT64)(a4), (UINT64)(a5))
+#define _cast64_efi_call6(f,a1,a2,a3,a4,a5,a6) \
+  efi_call6((void*)(f), (UINT64)(a1), (UINT64)(a2), (UINT64)(a3), (UINT64)(a4), (UINT64)(a5), (UINT64)(a6))
+#define _cast64_efi_call7(f,a1,a2,a3,a4,a5,a6,a7) \
+  efi_call7((void*)(f), (UINT64)(a1), (UINT64)(a2), (UINT64)(a3), (UINT64)(a4), (UINT64)(a5), (UINT64)(a6), (UINT64)(a7))
+
+#define uefi_call_wrapper(func, va_num, ...) _cast64_efi_call##va_num(func , ##__VA_ARGS__)
+
+// GUIDs
+
+typedef struct
+{
+  UINT32 Data1;
+  UINT16 Data2;
+  UINT16 Data3;
+  UINT8  Data4[8];
+} EFI_GUID;
+
+#define EFI_GLOBAL_VARIABLE \
+  { 0x8BE4DF61, 0x93CA, 0x11d2, {0xAA, 0x0D, 0x00, 0xE0, 0x98, 0x03, 0x2B, 0x8C} }
+#define EFI_SIMPLE_NETWORK_PROTOCOL \
+  { 0xA19832B9, 0xAC25, 0x11D3, {0x9A, 0x2D, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d} }
+#define SIMPLE_FILE_SYSTEM_PROTOCOL \
+  { 0x964e5b22, 0x6459, 0x11d2, {0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b} }
+#define LOADED_IMAGE_PROTOCOL \
+  { 0x5B1B31A1, 0x9562, 0x11d2, {0x8E, 0x3F, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B} }
+
+// Device paths
+
+typedef struct _EFI_DEVICE_PATH
+{
+  UINT8 Type;
+  UINT8 SubType;
+  UINT8 Length[2];
+} EFI_DEVICE_PATH;
+
+#define MEDIA_DEVICE_PATH         0x04
+#define MEDIA_HARDDRIVE_DP        0x01
+#define MEDIA_FILEPATH_DP         0x04
+#define END_DEVICE_PATH_TYPE      0x7f
+#define END_ENTIRE_DEVICE_PATH_SUBTYPE 0xff
+
+#define DevicePathType(a)         ((a)->Type & 0x7f)
+#define DevicePathSubType(a)      ((a)->SubType)
+#define DevicePathNodeLength(a)   ((UINTN)((a)->Length[0] | ((a)->Length[1] << 8)))
+#define NextDevicePathNode(a)     ((EFI_DEVICE_PATH*)(((UINT8*)(a)) + DevicePathNodeLength(a)))
+#define IsDevicePathEndType(a)    (DevicePathType(a) == END_DEVICE_PATH_TYPE)
+#define IsDevicePathEnd(a)        (IsDevicePathEndType(a) && DevicePathSubType(a) == END_ENTIRE_DEVICE_PATH_SUBTYPE)
+
+// Memory, events, timers
+
+typedef enum
+{
+  AllocateAnyPages,
+  AllocateMaxAddress,
+  AllocateAddress,
+  MaxAllocateType
+} EFI_ALLOCATE_TYPE;
+
+typedef enum
+{
+  EfiReservedMemoryType,
+  EfiLoaderCode,
+  EfiLoaderData,
+  EfiBootServicesCode,
+  EfiBootServicesData,
+  EfiMaxMemoryType = 15
+} EFI_MEMORY_TYPE;
+
+typedef enum
+{
+  AllHandles,
+  ByRegisterNotify,
+  ByProtocol
+} EFI_LOCATE_SEARCH_TYPE;
+
+typedef enum
+{
+  TimerCancel,
+  TimerPeriodic,
+  TimerRelative
+} EFI_TIMER_DELAY;
+
+#define EVT_TIMER                 0x80000000
+#define EVT_NOTIFY_WAIT           0x00000100
+#define EVT_NOTIFY_SIGNAL         0x00000200
+
+typedef UINTN EFI_TPL;
+#define TPL_APPLICATION           4
+#define TPL_CALLBACK              8
+
+typedef VOID (EFIAPI *EFI_EVENT_NOTIFY)(EFI_EVENT Event, VOID* Context);
+
+// Simple network
+
+typedef struct
+{
+  UINT8 Addr[32];
+} EFI_MAC_ADDRESS;
+
+typedef enum
+{
+  EfiSimpleNetworkStopped,
+  EfiSimpleNetworkStarted,
+  EfiSimpleNetworkInitialized,
+  EfiSimpleNetworkMaxState
+} EFI_SIMPLE_NETWORK_STATE;
+
+typedef struct
+{
+  UINT32          State;
+  UINT32          HwAddressSize;
+  UINT32          MediaHeaderSize;
+  UINT32          MaxPacketSize;
+  UINT32          NvRamSize;
+  UINT32          NvRamAccessSize;
+  UINT32          ReceiveFilterMask;
+  UINT32          ReceiveFilterSetting;
+  UINT32          MaxMCastFilterCount;
+  UINT32          MCastFilterCount;
+  EFI_MAC_ADDRESS MCastFilter[16];
+  EFI_MAC_ADDRESS CurrentAddress;
+  EFI_MAC_ADDRESS BroadcastAddress;
+  EFI_MAC_ADDRESS PermanentAddress;
+  UINT8           IfType;
+  BOOLEAN         MacAddressChangeable;
+  BOOLEAN         MultipleTxSupported;
+  BOOLEAN         MediaPresentSupported;
+  BOOLEAN         MediaPresent;
+} EFI_SIMPLE_NETWORK_MODE;
+
+typedef struct _EFI_SIMPLE_NETWORK EFI_SIMPLE_NETWORK;
+
+struct _EFI_SIMPLE_NETWORK
+{
+  UINT64 Revision;
+  EFI_STATUS (EFIAPI *Start)(EFI_SIMPLE_NETWORK* This);
+  EFI_STATUS (EFIAPI *Stop)(EFI_SIMPLE_NETWORK* This);
+  EFI_STATUS (EFIAPI *Initialize)(EFI_SIMPLE_NETWORK* This, UINTN ExtraRxBufferSize, UINTN ExtraTxBufferSize);
+  EFI_STATUS (EFIAPI *Reset)(EFI_SIMPLE_NETWORK* This, BOOLEAN ExtendedVerification);
+  EFI_STATUS (EFIAPI *Shutdown)(EFI_SIMPLE_NETWORK* This);
+  EFI_STATUS (EFIAPI *Transmit)(EFI_SIMPLE_NETWORK* This, UINTN HeaderSize, UINTN BufferSize, VOID* Buffer,
+                                EFI_MAC_ADDRESS* SrcAddr, EFI_MAC_ADDRESS* DestAddr, UINT16* Protocol);
+  EFI_STATUS (EFIAPI *Receive)(EFI_SIMPLE_NETWORK* This, UINTN* HeaderSize, UINTN* BufferSize, VOID* Buffer,
+                               EFI_MAC_ADDRESS* SrcAddr, EFI_MAC_ADDRESS* DestAddr, UINT16* Protocol);
+  EFI_EVENT WaitForPacket;
+  EFI_SIMPLE_NETWORK_MODE* Mode;
+};
+
+// Files
+
+#define EFI_FILE_MODE_READ        0x0000000000000001ULL
+#define EFI_FILE_MODE_WRITE       0x0000000000000002ULL
+#define EFI_FILE_MODE_CREATE      0x8000000000000000ULL
+
+typedef struct _EFI_FILE_HANDLE EFI_FILE;
+
+struct _EFI_FILE_HANDLE
+{
+  UINT64 Revision;
+  EFI_STATUS (EFIAPI *Open)(EFI_FILE* File, EFI_FILE** NewHandle, CHAR16* FileName, UINT64 OpenMode, UINT64 Attributes);
+  EFI_STATUS (EFIAPI *Close)(EFI_FILE* File);
+  EFI_STATUS (EFIAPI *Delete)(EFI_FILE* File);
+  EFI_STATUS (EFIAPI *Read)(EFI_FILE* File, UINTN* BufferSize, VOID* Buffer);
+  EFI_STATUS (EFIAPI *Write)(EFI_FILE* File, UINTN* BufferSize, VOID* Buffer);
+};
+
+typedef struct _EFI_FILE_IO_INTERFACE EFI_FILE_IO_INTERFACE;
+
+struct _EFI_FILE_IO_INTERFACE
+{
+  UINT64 Revision;
+  EFI_STATUS (EFIAPI *OpenVolume)(EFI_FILE_IO_INTERFACE* This, EFI_FILE** Root);
+};
+
+// Loaded image and system tables
+
+typedef struct _EFI_SYSTEM_TABLE EFI_SYSTEM_TABLE;
+
+typedef struct
+{
+  UINT32            Revision;
+  EFI_HANDLE        ParentHandle;
+  EFI_SYSTEM_TABLE* SystemTable;
+  EFI_HANDLE        DeviceHandle;
+  EFI_DEVICE_PATH*  FilePath;
+  VOID*             Reserved;
+  UINT32            LoadOptionsSize;
+  VOID*             LoadOptions;
+  VOID*             ImageBase;
+  UINT64            ImageSize;
+  EFI_MEMORY_TYPE   ImageCodeType;
+  EFI_MEMORY_TYPE   ImageDataType;
+} EFI_LOADED_IMAGE;
+
+typedef struct
+{
+  UINT64 Signature;
+  UINT32 Revision;
+  UINT32 HeaderSize;
+  UINT32 CRC32;
+  UINT32 Reserved;
+} EFI_TABLE_HEADER;
+
+typedef struct
+{
+  EFI_TABLE_HEADER Hdr;
+  EFI_STATUS (EFIAPI *AllocatePool)(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID** Buffer);
+  EFI_STATUS (EFIAPI *FreePool)(VOID* Buffer);
+  EFI_STATUS (EFIAPI *CreateEvent)(UINT32 Type, EFI_TPL NotifyTpl, EFI_EVENT_NOTIFY NotifyFunction,
+                                   VOID* NotifyContext, EFI_EVENT* Event);
+  EFI_STATUS (EFIAPI *SetTimer)(EFI_EVENT Event, EFI_TIMER_DELAY Type, UINT64 TriggerTime);
+  EFI_STATUS (EFIAPI *WaitForEvent)(UINTN NumberOfEvents, EFI_EVENT* Event, UINTN* Index);
+  EFI_STATUS (EFIAPI *SignalEvent)(EFI_EVENT Event);
+  EFI_STATUS (EFIAPI *CloseEvent)(EFI_EVENT Event);
+  EFI_STATUS (EFIAPI *CheckEvent)(EFI_EVENT Event);
+  EFI_STATUS (EFIAPI *HandleProtocol)(EFI_HANDLE Handle, const EFI_GUID* Protocol, VOID** Interface);
+  EFI_STATUS (EFIAPI *LocateHandleBuffer)(EFI_LOCATE_SEARCH_TYPE SearchType, const EFI_GUID* Protocol,
+                                          VOID* SearchKey, UINTN* NoHandles, EFI_HANDLE** Buffer);
+  EFI_STATUS (EFIAPI *LoadImage)(BOOLEAN BootPolicy, EFI_HANDLE ParentImageHandle, EFI_DEVICE_PATH* FilePath,
+                                 VOID* SourceBuffer, UINTN SourceSize, EFI_HANDLE* ImageHandle);
+  EFI_STATUS (EFIAPI *StartImage)(EFI_HANDLE ImageHandle, UINTN* ExitDataSize, CHAR16** ExitData);
+  EFI_STATUS (EFIAPI *UnloadImage)(EFI_HANDLE ImageHandle);
+  EFI_STATUS (EFIAPI *Stall)(UINTN Microseconds);
+  EFI_STATUS (EFIAPI *GetNextMonotonicCount)(UINT64* Count);
+} EFI_BOOT_SERVICES;
+
+typedef struct
+{
+  EFI_TABLE_HEADER Hdr;
+  EFI_STATUS (EFIAPI *GetVariable)(CHAR16* VariableName, const EFI_GUID* VendorGuid, UINT32* Attributes,
+                                   UINTN* DataSize, VOID* Data);
+  EFI_STATUS (EFIAPI *SetVariable)(CHAR16* VariableName, const EFI_GUID* VendorGuid, UINT32 Attributes,
+                                   UINTN DataSize, VOID* Data);
+} EFI_RUNTIME_SERVICES;
+
+#define EFI_VARIABLE_NON_VOLATILE       0x00000001
+#define EFI_VARIABLE_BOOTSERVICE_ACCESS 0x00000002
+#define EFI_VARIABLE_RUNTIME_ACCESS     0x00000004
+
+struct _EFI_SYSTEM_TABLE
+{
+  EFI_TABLE_HEADER      Hdr;
+  CHAR16*               FirmwareVendor;
+  UINT32                FirmwareRevision;
+  EFI_RUNTIME_SERVICES* RuntimeServices;
+  EFI_BOOT_SERVICES*    BootServices;
+};
+
+#endif
@@ -0,0 +1,376 @@
+/*
+
+UEFI Network Boot Switch - host build
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Host versions of the GNU-EFI library functions used by unbs.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "efilib.h"
+#include "mock.h"
+
+EFI_SYSTEM_TABLE*     ST = NULL;
+EFI_BOOT_SERVICES*    BS = NULL;
+EFI_RUNTIME_SERVICES* RT = NULL;
+
+VOID InitializeLib(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE* SystemTable)
+{
+  ST = SystemTable;
+  BS = SystemTable->BootServices;
+  RT = SystemTable->RuntimeServices;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Calling convention
+
+typedef UINT64 (*efi_fn0_t)();
+typedef UINT64 (*efi_fn1_t)(UINT64);
+typedef UINT64 (*efi_fn2_t)(UINT64, UINT64);
+typedef UINT64 (*efi_fn3_t)(UINT64, UINT64, UINT64);
+typedef UINT64 (*efi_fn4_t)(UINT64, UINT64, UINT64, UINT64);
+typedef UINT64 (*efi_fn5_t)(UINT64, UINT64, UINT64, UINT64, UINT64);
+typedef UINT64 (*efi_fn6_t)(UINT64, UINT64, UINT64, UINT64, UINT64, UINT64);
+typedef UINT64 (*efi_fn7_t)(UINT64, UINT64, UINT64, UINT64, UINT64, UINT64, UINT64);
+
+UINT64 efi_call0(void* func) { return ((efi_fn0_t)func)(); }
+UINT64 efi_call1(void* func, UINT64 a1) { return ((efi_fn1_t)func)(a1); }
+UINT64 efi_call2(void* func, UINT64 a1, UINT64 a2) { return ((efi_fn2_t)func)(a1, a2); }
+UINT64 efi_call3(void* func, UINT64 a1, UINT64 a2, UINT64 a3) { return ((efi_fn3_t)func)(a1, a2, a3); }
+UINT64 efi_call4(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4)
+  { return ((efi_fn4_t)func)(a1, a2, a3, a4); }
+UINT64 efi_call5(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4, UINT64 a5)
+  { return ((efi_fn5_t)func)(a1, a2, a3, a4, a5); }
+UINT64 efi_call6(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4, UINT64 a5, UINT64 a6)
+  { return ((efi_fn6_t)func)(a1, a2, a3, a4, a5, a6); }
+UINT64 efi_call7(void* func, UINT64 a1, UINT64 a2, UINT64 a3, UINT64 a4, UINT64 a5, UINT64 a6, UINT64 a7)
+  { return ((efi_fn7_t)func)(a1, a2, a3, a4, a5, a6, a7); }
+
+// -----------------------------------------------------------------------------------------------
+// Print
+
+static const char* statusString(EFI_STATUS status)
+{
+  switch(status)
+  {
+    case EFI_SUCCESS:           return "Success";
+    case EFI_LOAD_ERROR:        return "Load Error";
+    case EFI_INVALID_PARAMETER: return "Invalid Parameter";
+    case EFI_UNSUPPORTED:       return "Unsupported";
+    case EFI_BAD_BUFFER_SIZE:   return "Bad Buffer Size";
+    case EFI_BUFFER_TOO_SMALL:  return "Buffer Too Small";
+    case EFI_NOT_READY:         return "Not Ready";
+    case EFI_DEVICE_ERROR:      return "Device Error";
+    case EFI_WRITE_PROTECTED:   return "Write Protected";
+    case EFI_OUT_OF_RESOURCES:  return "Out of Resources";
+    case EFI_NOT_FOUND:         return "Not Found";
+    case EFI_TIMEOUT:           return "Time out";
+    case EFI_NOT_STARTED:       return "Not started";
+    case EFI_ALREADY_STARTED:   return "Already started";
+    case EFI_ABORTED:           return "Aborted";
+    case EFI_SECURITY_VIOLATION: return "Security Violation";
+    default:                    return NULL;
+  }
+}
+
+typedef struct
+{
+  char* out;
+  size_t size;
+  size_t pos;
+} fmt_out_t;
+
+static void fmtChar(fmt_out_t* o, char c)
+{
+  if (o->pos + 1 < o->size) o->out[o->pos] = c;
+  o->pos++;
+}
+
+static void fmtField(fmt_out_t* o, const char* s, UINTN width, char pad, char left)
+{
+  UINTN len = strlen(s);
+  if (!left) for (UINTN i = len; i < width; i++) fmtChar(o, pad);
+  for (UINTN i = 0; i < len; i++) fmtChar(o, s[i]);
+  if (left) for (UINTN i = len; i < width; i++) fmtChar(o, ' ');
+}
+
+// Formats GNU-EFI style: wide format string, %s takes a CHAR16 string, %a an
+// ASCII one, %r an EFI_STATUS. Hex digits are upper case as in GNU-EFI.
+static void formatW(fmt_out_t* o, const CHAR16* fmt, va_list args)
+{
+  char num[64];
+
+  for (; *fmt; fmt++)
+  {
+    if (*fmt != '%')
+    {
+      fmtChar(o, (*fmt < 0x80) ? (char)*fmt : '?');
+      continue;
+    }
+
+    UINTN width = 0;
+    char pad = ' ';
+    char left = 0;
+    char isLong = 0;
+    char precision = 0;
+
+    for (fmt++; *fmt; fmt++)
+    {
+      if (*fmt == '-') left = 1;
+      else if (*fmt == '0' && (!width || precision)) pad = '0';
+      else if (*fmt >= '0' && *fmt <= '9') { if (!precision) width = width * 10 + (*fmt - '0'); }
+      else if (*fmt == '.') precision = 1;
+      else if (*fmt == '*') width = va_arg(args, UINTN);
+      else if (*fmt == 'l') isLong = 1;
+      else break;
+    }
+    if (!*fmt) break;
+
+    switch(*fmt)
+    {
+      case 'd':
+        if (isLong) snprintf(num, sizeof(num), "%lld", (long long)va_arg(args, INT64));
+        else snprintf(num, sizeof(num), "%d", va_arg(args, int));
+        fmtField(o, num, width, pad, left);
+        break;
+      case 'u':
+        if (isLong) snprintf(num, sizeof(num), "%llu", (unsigned long long)va_arg(args, UINT64));
+        else snprintf(num, sizeof(num), "%u", va_arg(args, unsigned int));
+        fmtField(o, num, width, pad, left);
+        break;
+      case 'x':
+      case 'X':
+        if (isLong) snprintf(num, sizeof(num), "%llX", (unsigned long long)va_arg(args, UINT64));
+        else snprintf(num, sizeof(num), "%X", va_arg(args, unsigned int));
+        if (*fmt == 'X') pad = '0';
+        fmtField(o, num, width, pad, left);
+        break;
+      case 'c':
+        num[0] = (char)va_arg(args, int);
+        num[1] = 0;
+        fmtField(o, num, width, ' ', left);
+        break;
+      case 'a':
+      {
+        const char* s = va_arg(args, const char*);
+        fmtField(o, s ? s : "(null)", width, ' ', left);
+        break;
+      }
+      case 's':
+      {
+        const CHAR16* s = va_arg(args, const CHAR16*);
+        if (!s) { fmtField(o, "(null)", width, ' ', left); break; }
+        UINTN len = StrLen(s);
+        if (!left) for (UINTN i = len; i < width; i++) fmtChar(o, ' ');
+        for (UINTN i = 0; i < len; i++) fmtChar(o, (s[i] < 0x80) ? (char)s[i] : '?');
+        if (left) for (UINTN i = len; i < width; i++) fmtChar(o, ' ');
+        break;
+      }
+      case 'r':
+      {
+        EFI_STATUS status = va_arg(args, EFI_STATUS);
+        const char* s = statusString(status);
+        if (!s)
+        {
+          snprintf(num, sizeof(num), "%llX", (unsigned long long)status);
+          s = num;
+        }
+        fmtField(o, s, width, ' ', left);
+        break;
+      }
+      default:
+        fmtChar(o, (char)*fmt);
+        break;
+    }
+  }
+
+  if (o->size) o->out[(o->pos < o->size) ? o->pos : o->size - 1] = 0;
+}
+
+static void consoleDelay(size_t chars)
+{
+  if (!mockConfig.consoleCharUs || !chars) return;
+  UINT64 ns = (UINT64)chars * mockConfig.consoleCharUs * 1000;
+  struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+  nanosleep(&ts, NULL);
+}
+
+UINTN Print(const CHAR16* fmt, ...)
+{
+  char buffer[1024];
+  fmt_out_t o = { buffer, sizeof(buffer), 0 };
+  va_list args;
+  va_start(args, fmt);
+  formatW(&o, fmt, args);
+  va_end(args);
+
+  size_t len = strlen(buffer);
+  if (!mockConfig.quiet) fputs(buffer, stdout);
+  consoleDelay(len);
+  return len;
+}
+
+UINTN SPrint(CHAR16* Str, UINTN StrSize, const CHAR16* fmt, ...) // StrSize in bytes
+{
+  char buffer[1024];
+  fmt_out_t o = { buffer, sizeof(buffer), 0 };
+  va_list args;
+  va_start(args, fmt);
+  formatW(&o, fmt, args);
+  va_end(args);
+
+  UINTN maxChars = StrSize / sizeof(CHAR16);
+  if (!maxChars) return 0;
+  UINTN i;
+  for (i = 0; buffer[i] && (i < maxChars - 1); i++) Str[i] = (CHAR16)buffer[i];
+  Str[i] = 0;
+  return i;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Memory and strings
+
+VOID* AllocatePool(UINTN Size)
+{
+  return malloc(Size ? Size : 1);
+}
+
+VOID* AllocateZeroPool(UINTN Size)
+{
+  return calloc(1, Size ? Size : 1);
+}
+
+VOID FreePool(VOID* Buffer)
+{
+  free(Buffer);
+}
+
+VOID CopyMem(VOID* Dest, const VOID* Src, UINTN len)
+{
+  memmove(Dest, Src, len);
+}
+
+VOID ZeroMem(VOID* Buffer, UINTN Size)
+{
+  memset(Buffer, 0, Size);
+}
+
+INTN CompareMem(const VOID* Dest, const VOID* Src, UINTN len)
+{
+  return memcmp(Dest, Src, len);
+}
+
+UINTN StrLen(const CHAR16* s1)
+{
+  UINTN len = 0;
+  while (s1[len]) len++;
+  return len;
+}
+
+INTN StrCmp(const CHAR16* s1, const CHAR16* s2)
+{
+  while (*s1 && (*s1 == *s2)) { s1++; s2++; }
+  return (INTN)*s1 - (INTN)*s2;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Device paths
+
+UINTN DevicePathSize(EFI_DEVICE_PATH* DevPath)
+{
+  EFI_DEVICE_PATH* node = DevPath;
+  while (!IsDevicePathEnd(node)) node = NextDevicePathNode(node);
+  return ((UINT8*)node - (UINT8*)DevPath) + DevicePathNodeLength(node);
+}
+
+EFI_DEVICE_PATH* DuplicateDevicePath(EFI_DEVICE_PATH* DevPath)
+{
+  UINTN size = DevicePathSize(DevPath);
+  EFI_DEVICE_PATH* toReturn = AllocatePool(size);
+  CopyMem(toReturn, DevPath, size);
+  return toReturn;
+}
+
+EFI_DEVICE_PATH* AppendDevicePath(EFI_DEVICE_PATH* Src1, EFI_DEVICE_PATH* Src2)
+{
+  if (!Src1) return DuplicateDevicePath(Src2);
+  if (!Src2) return DuplicateDevicePath(Src1);
+
+  UINTN size1 = DevicePathSize(Src1) - sizeof(EFI_DEVICE_PATH); // Drop End node of Src1
+  UINTN size2 = DevicePathSize(Src2);
+  UINT8* toReturn = AllocatePool(size1 + size2);
+  CopyMem(toReturn, Src1, size1);
+  CopyMem(toReturn + size1, Src2, size2);
+  return (EFI_DEVICE_PATH*)toReturn;
+}
+
+BOOLEAN LibMatchDevicePaths(EFI_DEVICE_PATH* Multi, EFI_DEVICE_PATH* Single)
+{
+  if (!Multi || !Single) return FALSE;
+
+  // Only single instance paths are produced by the mock; compare up to the end node
+  UINTN size = DevicePathSize(Multi) - sizeof(EFI_DEVICE_PATH);
+  return CompareMem(Single, Multi, size) == 0;
+}
+
+CHAR16* DevicePathToStr(EFI_DEVICE_PATH* DevPath)
+{
+  char buffer[512];
+  size_t pos = 0;
+  buffer[0] = 0;
+
+  for (EFI_DEVICE_PATH* node = DevPath; !IsDevicePathEnd(node); node = NextDevicePathNode(node))
+  {
+    if (pos && pos < sizeof(buffer)) pos += snprintf(buffer + pos, sizeof(buffer) - pos, "/");
+    if (pos >= sizeof(buffer)) break;
+
+    UINT8* data = (UINT8*)(node + 1);
+
+    if (DevicePathType(node) == MEDIA_DEVICE_PATH && DevicePathSubType(node) == MEDIA_HARDDRIVE_DP)
+    {
+      UINT32 partition;
+      CopyMem(&partition, data, 4);
+      pos += snprintf(buffer + pos, sizeof(buffer) - pos, "HD(Part%u,Sig%02X%02X%02X%02X)",
+                      partition, data[20], data[21], data[22], data[23]);
+    }
+    else if (DevicePathType(node) == MEDIA_DEVICE_PATH && DevicePathSubType(node) == MEDIA_FILEPATH_DP)
+    {
+      CHAR16* name = (CHAR16*)data;
+      UINTN len = (DevicePathNodeLength(node) - sizeof(EFI_DEVICE_PATH)) / sizeof(CHAR16);
+      for (UINTN i = 0; i < len && name[i] && pos + 1 < sizeof(buffer); i++)
+        buffer[pos++] = (name[i] < 0x80) ? (char)name[i] : '?';
+      buffer[pos] = 0;
+    }
+    else
+    {
+      pos += snprintf(buffer + pos, sizeof(buffer) - pos, "Path(%u,%u)",
+                      DevicePathType(node), DevicePathSubType(node));
+    }
+  }
+
+  if (pos >= sizeof(buffer)) pos = sizeof(buffer) - 1;
+  CHAR16* toReturn = AllocateZeroPool((pos + 1) * sizeof(CHAR16));
+  for (size_t i = 0; i < pos; i++) toReturn[i] = (CHAR16)(UINT8)buffer[i];
+  return toReturn;
+}
@@ -0,0 +1,56 @@
+/*
+
+UEFI Network Boot Switch - host build
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Stand-in for the GNU-EFI <efilib.h>. Implemented in efilib.c.
+ */
+
+#ifndef UNBS_HOST_EFILIB_H
+#define UNBS_HOST_EFILIB_H
+
+#include "efi.h"
+
+extern EFI_SYSTEM_TABLE*     ST;
+extern EFI_BOOT_SERVICES*    BS;
+extern EFI_RUNTIME_SERVICES* RT;
+
+VOID InitializeLib(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE* SystemTable);
+
+UINTN Print(const CHAR16* fmt, ...);
+UINTN SPrint(CHAR16* Str, UINTN StrSize, const CHAR16* fmt, ...);
+
+VOID* AllocatePool(UINTN Size);
+VOID* AllocateZeroPool(UINTN Size);
+VOID  FreePool(VOID* Buffer);
+VOID  CopyMem(VOID* Dest, const VOID* Src, UINTN len);
+VOID  ZeroMem(VOID* Buffer, UINTN Size);
+INTN  CompareMem(const VOID* Dest, const VOID* Src, UINTN len);
+
+UINTN StrLen(const CHAR16* s1);
+INTN  StrCmp(const CHAR16* s1, const CHAR16* s2);
+
+UINTN            DevicePathSize(EFI_DEVICE_PATH* DevPath);
+CHAR16*          DevicePathToStr(EFI_DEVICE_PATH* DevPath);
+EFI_DEVICE_PATH* DevicePathFromHandle(EFI_HANDLE Handle);
+EFI_DEVICE_PATH* AppendDevicePath(EFI_DEVICE_PATH* Src1, EFI_DEVICE_PATH* Src2);
+EFI_DEVICE_PATH* DuplicateDevicePath(EFI_DEVICE_PATH* DevPath);
+BOOLEAN          LibMatchDevicePaths(EFI_DEVICE_PATH* Multi, EFI_DEVICE_PATH* Single);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+
+UEFI Network Boot Switch - host build
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Control interface of the mock firmware. The bench driver fills in
+ * mockConfig, calls mockInit() once, then mockResetRun() before each call
+ * to efi_main(). mockRun collects what happened during that call.
+ */
+
+#ifndef UNBS_HOST_MOCK_H
+#define UNBS_HOST_MOCK_H
+
+#include <time.h>
+#include "efi.h"
+
+typedef struct mock_config_tt
+{
+  const char* ifName;         // Interface the simple network protocol is bound to (AF_PACKET)
+  const char* espDir;         // Directory standing in for the EFI system partition
+  const char* varDir;         // Directory of NVRAM variables, efivarfs layout
+  unsigned int lossPercent;   // Chance of dropping each transmitted or received frame
+  unsigned int delayMs;       // Added delay before a received frame can be read
+  unsigned int jitterMs;      // Random extra delay, 0..jitterMs
+  unsigned int pollCostUs;    // Time taken by each SNP Receive call
+  unsigned int consoleCharUs; // Time taken per character written by Print (serial console)
+  unsigned int variableCostUs; // Time taken by each GetVariable (flash read)
+  unsigned int loadCostUs;    // Time taken by each LoadImage (reading the loader from disk)
+  unsigned int timerScale;    // Timer events fire this many times faster than asked
+  int quiet;                  // Discard console output
+} mock_config_t;
+
+typedef struct mock_run_tt
+{
+  struct timespec handOff;       // efi_main entered
+  struct timespec firstTransmit;
+  struct timespec firstReply;    // First UNBS protocol frame handed to the caller
+  struct timespec decision;      // Last UNBS protocol frame handed to the caller
+  struct timespec startImage;
+  unsigned int transmits;
+  unsigned int receiveCalls;
+  unsigned int framesDropped;
+  unsigned int loads;
+  unsigned int unloads;
+  char gotReply;
+  char started;
+  char startedPath[256];
+} mock_run_t;
+
+extern mock_config_t mockConfig;
+extern mock_run_t mockRun;
+
+extern EFI_HANDLE mockImageHandle;
+extern EFI_SYSTEM_TABLE mockSystemTable;
+
+int mockInit();
+void mockResetRun();
+void mockShutdown();
+int mockWriteLoadOption(UINT16 number, const char* description, const char* path);
+int mockWriteBootOrder(const UINT16* order, UINTN count);
+double mockElapsedMs(const struct timespec* from, const struct timespec* to);
+void mockStamp(struct timespec* ts);
+
+// Internal to the mock
+
+int mockNetInit();
+void mockNetReset();
+void mockNetShutdown();
+EFI_EVENT mockCreatePacketEvent();
+int mockNetPacketReady(int* timeoutMs);
+int mockNetFd();
+extern EFI_SIMPLE_NETWORK mockNet;
+
+#endif
@@ -0,0 +1,667 @@
+/*
+
+UEFI Network Boot Switch - host build
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Mock boot services, runtime services and the handles unbs.c looks for:
+ *   - one network handle (simple network, see snp.c)
+ *   - one disk handle (simple file system backed by mockConfig.espDir)
+ *   - the image handle of unbs itself (loaded image, lives on the disk)
+ * Timer events are timerfds, WaitForEvent is poll().
+ * NVRAM variables are files in mockConfig.varDir in efivarfs layout:
+ * named Name-GUID, holding 4 bytes of attributes followed by the data.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "efilib.h"
+#include "mock.h"
+
+static const EFI_GUID SimpleNetworkGUID = EFI_SIMPLE_NETWORK_PROTOCOL;
+static const EFI_GUID SimpleFileSystemGUID = SIMPLE_FILE_SYSTEM_PROTOCOL;
+static const EFI_GUID LoadedImageGUID = LOADED_IMAGE_PROTOCOL;
+
+mock_config_t mockConfig = {
+  .ifName = NULL,
+  .espDir = "esp",
+  .varDir = "vars",
+  .timerScale = 1,
+};
+mock_run_t mockRun;
+
+static char imageToken, netToken, diskToken;
+
+// Loaded but not yet started or unloaded images
+#define MAX_CHILD_IMAGES 4
+typedef struct child_image_tt
+{
+  char inUse;
+  char path[256];
+} child_image_t;
+static child_image_t childImages[MAX_CHILD_IMAGES];
+EFI_HANDLE mockImageHandle = &imageToken;
+static EFI_HANDLE netHandle = &netToken;
+static EFI_HANDLE diskHandle = &diskToken;
+
+// PciRoot(0)/HD(1,GPT,...) - the disk holding the ESP and every boot loader
+
+static const UINT8 diskDevicePath[] = {
+  0x02, 0x01, 12, 0,                                // ACPI, PNP0A03
+  0xD0, 0x41, 0x03, 0x0A, 0x00, 0x00, 0x00, 0x00,
+  0x04, 0x01, 42, 0,                                // HD
+  0x01, 0x00, 0x00, 0x00,                           // Partition 1
+  0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   // Start 2048
+  0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,   // Size 1048576
+  0x55, 0x4E, 0x42, 0x53, 0x00, 0x00, 0x00, 0x00,   // Signature
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+  0x02, 0x02,                                       // GPT
+  0x7F, 0xFF, 4, 0                                  // End
+};
+#define DISK_HD_OFFSET 12
+#define DISK_HD_LENGTH 42
+
+// -----------------------------------------------------------------------------------------------
+// Time
+
+void mockStamp(struct timespec* ts)
+{
+  clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+double mockElapsedMs(const struct timespec* from, const struct timespec* to)
+{
+  return ((to->tv_sec - from->tv_sec) * 1000.0) + ((to->tv_nsec - from->tv_nsec) / 1000000.0);
+}
+
+// -----------------------------------------------------------------------------------------------
+// Events
+
+typedef struct mock_event_tt
+{
+  int isPacket;
+  int fd;
+} mock_event_t;
+
+EFI_EVENT mockCreatePacketEvent()
+{
+  mock_event_t* event = AllocateZeroPool(sizeof(mock_event_t));
+  event->isPacket = 1;
+  event->fd = -1;
+  return event;
+}
+
+// Returns 1 if signalled, clearing the signal. Otherwise sets *timeoutMs to
+// how long until it might be, or -1 if only its fd can tell.
+static int eventCheck(mock_event_t* event, int* timeoutMs)
+{
+  *timeoutMs = -1;
+  if (event->isPacket) return mockNetPacketReady(timeoutMs);
+
+  uint64_t expirations;
+  return read(event->fd, &expirations, sizeof(expirations)) == sizeof(expirations);
+}
+
+static EFI_STATUS EFIAPI mockCreateEvent(UINT32 Type, EFI_TPL NotifyTpl, EFI_EVENT_NOTIFY NotifyFunction,
+                                         VOID* NotifyContext, EFI_EVENT* Event)
+{
+  if (!Event) return EFI_INVALID_PARAMETER;
+  if (!(Type & EVT_TIMER) || NotifyFunction) return EFI_UNSUPPORTED; // Timer events only
+
+  mock_event_t* event = AllocateZeroPool(sizeof(mock_event_t));
+  event->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (event->fd < 0)
+  {
+    FreePool(event);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  *Event = event;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockSetTimer(EFI_EVENT Event, EFI_TIMER_DELAY Type, UINT64 TriggerTime)
+{
+  mock_event_t* event = Event;
+  if (!event || event->isPacket) return EFI_INVALID_PARAMETER;
+
+  // TriggerTime is in 100ns units
+  UINT64 ns = (TriggerTime * 100) / (mockConfig.timerScale ? mockConfig.timerScale : 1);
+  if (!ns) ns = 1; // Zero would disarm the timerfd; EFI fires on the next tick
+
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if (Type != TimerCancel)
+  {
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    if (Type == TimerPeriodic) spec.it_interval = spec.it_value;
+  }
+
+  if (timerfd_settime(event->fd, 0, &spec, NULL)) return EFI_DEVICE_ERROR;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockWaitForEvent(UINTN NumberOfEvents, EFI_EVENT* Event, UINTN* Index)
+{
+  if (!NumberOfEvents || NumberOfEvents > 16 || !Event || !Index) return EFI_INVALID_PARAMETER;
+
+  struct pollfd fds[16];
+  while(1)
+  {
+    int timeout = -1;
+    int numFds = 0;
+    for (UINTN i = 0; i < NumberOfEvents; i++)
+    {
+      mock_event_t* event = Event[i];
+      int eventTimeout;
+      if (eventCheck(event, &eventTimeout))
+      {
+        *Index = i;
+        return EFI_SUCCESS;
+      }
+      if ((eventTimeout >= 0) && ((timeout < 0) || (eventTimeout < timeout))) timeout = eventTimeout;
+
+      fds[numFds].fd = event->isPacket ? mockNetFd() : event->fd;
+      fds[numFds].events = POLLIN;
+      numFds++;
+    }
+
+    if ((poll(fds, numFds, timeout) < 0) && (errno != EINTR)) return EFI_DEVICE_ERROR;
+  }
+}
+
+static EFI_STATUS EFIAPI mockCheckEvent(EFI_EVENT Event)
+{
+  int timeout;
+  if (!Event) return EFI_INVALID_PARAMETER;
+  return eventCheck(Event, &timeout) ? EFI_SUCCESS : EFI_NOT_READY;
+}
+
+static EFI_STATUS EFIAPI mockSignalEvent(EFI_EVENT Event)
+{
+  return EFI_UNSUPPORTED;
+}
+
+static EFI_STATUS EFIAPI mockCloseEvent(EFI_EVENT Event)
+{
+  mock_event_t* event = Event;
+  if (!event || event->isPacket) return EFI_INVALID_PARAMETER;
+  close(event->fd);
+  FreePool(event);
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockStall(UINTN Microseconds)
+{
+  usleep(Microseconds);
+  return EFI_SUCCESS;
+}
+
+// High 32 bits count boots (see mockResetRun), low 32 bits count calls this boot
+static UINT64 monotonicCount = 0;
+
+static EFI_STATUS EFIAPI mockGetNextMonotonicCount(UINT64* Count)
+{
+  if (!Count) return EFI_INVALID_PARAMETER;
+  *Count = monotonicCount++;
+  return EFI_SUCCESS;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Memory
+
+static EFI_STATUS EFIAPI mockAllocatePool(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID** Buffer)
+{
+  *Buffer = AllocatePool(Size);
+  return *Buffer ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+static EFI_STATUS EFIAPI mockFreePool(VOID* Buffer)
+{
+  FreePool(Buffer);
+  return EFI_SUCCESS;
+}
+
+// -----------------------------------------------------------------------------------------------
+// File system on the ESP directory
+
+typedef struct mock_file_tt
+{
+  EFI_FILE file; // Must be first
+  FILE* fp;
+  char path[512];
+} mock_file_t;
+
+static EFI_STATUS EFIAPI fileOpen(EFI_FILE* File, EFI_FILE** NewHandle, CHAR16* FileName, UINT64 OpenMode, UINT64 Attributes);
+static EFI_STATUS EFIAPI fileClose(EFI_FILE* File);
+static EFI_STATUS EFIAPI fileDelete(EFI_FILE* File);
+static EFI_STATUS EFIAPI fileRead(EFI_FILE* File, UINTN* BufferSize, VOID* Buffer);
+static EFI_STATUS EFIAPI fileWrite(EFI_FILE* File, UINTN* BufferSize, VOID* Buffer);
+
+static mock_file_t rootDir = {
+  .file = { 0x00010000, fileOpen, fileClose, fileDelete, fileRead, fileWrite },
+  .fp = NULL,
+};
+
+// Turn an EFI path such as \EFI\UNBS\server.mac into a host path under espDir
+static void espPath(char* out, size_t outSize, const CHAR16* name)
+{
+  size_t pos = snprintf(out, outSize, "%s/", mockConfig.espDir);
+  while (*name == '\\') name++;
+  for (; *name && (pos + 1 < outSize); name++)
+    out[pos++] = (*name == '\\') ? '/' : (char)*name;
+  out[pos] = 0;
+}
+
+static EFI_STATUS EFIAPI fileOpen(EFI_FILE* File, EFI_FILE** NewHandle, CHAR16* FileName, UINT64 OpenMode, UINT64 Attributes)
+{
+  if (!NewHandle || !FileName) return EFI_INVALID_PARAMETER;
+
+  mock_file_t* newFile = AllocateZeroPool(sizeof(mock_file_t));
+  newFile->file = rootDir.file;
+  espPath(newFile->path, sizeof(newFile->path), FileName);
+
+  const char* mode = "rb";
+  if (OpenMode & EFI_FILE_MODE_WRITE) mode = (OpenMode & EFI_FILE_MODE_CREATE) ? "w+b" : "r+b";
+
+  newFile->fp = fopen(newFile->path, mode);
+  if (!newFile->fp)
+  {
+    FreePool(newFile);
+    return EFI_NOT_FOUND;
+  }
+
+  *NewHandle = &newFile->file;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI fileClose(EFI_FILE* File)
+{
+  mock_file_t* file = (mock_file_t*)File;
+  if (file == &rootDir) return EFI_SUCCESS;
+  fclose(file->fp);
+  FreePool(file);
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI fileDelete(EFI_FILE* File)
+{
+  mock_file_t* file = (mock_file_t*)File;
+  if (file == &rootDir) return EFI_WRITE_PROTECTED;
+  fclose(file->fp);
+  int r = remove(file->path);
+  FreePool(file);
+  return r ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI fileRead(EFI_FILE* File, UINTN* BufferSize, VOID* Buffer)
+{
+  mock_file_t* file = (mock_file_t*)File;
+  if (!file->fp) return EFI_UNSUPPORTED;
+  *BufferSize = fread(Buffer, 1, *BufferSize, file->fp);
+  return ferror(file->fp) ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI fileWrite(EFI_FILE* File, UINTN* BufferSize, VOID* Buffer)
+{
+  mock_file_t* file = (mock_file_t*)File;
+  if (!file->fp) return EFI_UNSUPPORTED;
+  *BufferSize = fwrite(Buffer, 1, *BufferSize, file->fp);
+  return ferror(file->fp) ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockOpenVolume(EFI_FILE_IO_INTERFACE* This, EFI_FILE** Root)
+{
+  *Root = &rootDir.file;
+  return EFI_SUCCESS;
+}
+
+static EFI_FILE_IO_INTERFACE fileIo = { 0x00010000, mockOpenVolume };
+
+// -----------------------------------------------------------------------------------------------
+// Handles and protocols
+
+static EFI_LOADED_IMAGE loadedImage = {
+  .Revision = 0x1000,
+  .SystemTable = &mockSystemTable,
+};
+
+static int guidEqual(const EFI_GUID* a, const EFI_GUID* b)
+{
+  return !memcmp(a, b, sizeof(EFI_GUID));
+}
+
+static EFI_STATUS EFIAPI mockHandleProtocol(EFI_HANDLE Handle, const EFI_GUID* Protocol, VOID** Interface)
+{
+  if (!Handle || !Protocol || !Interface) return EFI_INVALID_PARAMETER;
+
+  if ((Handle == mockImageHandle) && guidEqual(Protocol, &LoadedImageGUID))
+    *Interface = &loadedImage;
+  else if ((Handle == diskHandle) && guidEqual(Protocol, &SimpleFileSystemGUID))
+    *Interface = &fileIo;
+  else if ((Handle == netHandle) && guidEqual(Protocol, &SimpleNetworkGUID))
+    *Interface = &mockNet;
+  else
+    return EFI_UNSUPPORTED;
+
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockLocateHandleBuffer(EFI_LOCATE_SEARCH_TYPE SearchType, const EFI_GUID* Protocol,
+                                                VOID* SearchKey, UINTN* NoHandles, EFI_HANDLE** Buffer)
+{
+  if ((SearchType != ByProtocol) || !Protocol || !NoHandles || !Buffer) return EFI_INVALID_PARAMETER;
+
+  EFI_HANDLE handle;
+  if (guidEqual(Protocol, &SimpleNetworkGUID)) handle = netHandle;
+  else if (guidEqual(Protocol, &SimpleFileSystemGUID)) handle = diskHandle;
+  else return EFI_NOT_FOUND;
+
+  *Buffer = AllocatePool(sizeof(EFI_HANDLE));
+  (*Buffer)[0] = handle;
+  *NoHandles = 1;
+  return EFI_SUCCESS;
+}
+
+EFI_DEVICE_PATH* DevicePathFromHandle(EFI_HANDLE Handle)
+{
+  if (Handle == diskHandle) return (EFI_DEVICE_PATH*)diskDevicePath;
+  return NULL;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Images
+
+static EFI_STATUS EFIAPI mockLoadImage(BOOLEAN BootPolicy, EFI_HANDLE ParentImageHandle, EFI_DEVICE_PATH* FilePath,
+                                       VOID* SourceBuffer, UINTN SourceSize, EFI_HANDLE* ImageHandle)
+{
+  if (!FilePath || !ImageHandle) return EFI_INVALID_PARAMETER;
+  mockRun.loads++;
+  if (mockConfig.loadCostUs) usleep(mockConfig.loadCostUs);
+
+  child_image_t* child = NULL;
+  for (UINTN c = 0; c < MAX_CHILD_IMAGES; c++)
+  {
+    if (childImages[c].inUse) continue;
+    child = &childImages[c];
+    break;
+  }
+  if (!child) return EFI_OUT_OF_RESOURCES;
+
+  // Must be our disk followed by a file that exists on it
+  UINTN diskSize = sizeof(diskDevicePath) - sizeof(EFI_DEVICE_PATH);
+  if (CompareMem(FilePath, diskDevicePath, diskSize)) return EFI_NOT_FOUND;
+
+  EFI_DEVICE_PATH* node = (EFI_DEVICE_PATH*)((UINT8*)FilePath + diskSize);
+  if ((DevicePathType(node) != MEDIA_DEVICE_PATH) || (DevicePathSubType(node) != MEDIA_FILEPATH_DP))
+    return EFI_NOT_FOUND;
+
+  char path[512];
+  espPath(path, sizeof(path), (CHAR16*)(node + 1));
+  if (access(path, R_OK)) return EFI_NOT_FOUND;
+
+  CHAR16* pathStr = DevicePathToStr(FilePath);
+  UINTN i;
+  for (i = 0; pathStr[i] && (i < sizeof(child->path) - 1); i++) child->path[i] = (char)pathStr[i];
+  child->path[i] = 0;
+  FreePool(pathStr);
+
+  child->inUse = 1;
+  *ImageHandle = child;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockStartImage(EFI_HANDLE ImageHandle, UINTN* ExitDataSize, CHAR16** ExitData)
+{
+  mockStamp(&mockRun.startImage);
+  child_image_t* child = ImageHandle;
+  if ((child < childImages) || (child >= &childImages[MAX_CHILD_IMAGES]) || !child->inUse)
+    return EFI_INVALID_PARAMETER;
+
+  mockRun.started = 1;
+  memcpy(mockRun.startedPath, child->path, sizeof(mockRun.startedPath));
+  child->inUse = 0; // As if the loader returned straight away and was unloaded
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockUnloadImage(EFI_HANDLE ImageHandle)
+{
+  child_image_t* child = ImageHandle;
+  if ((child < childImages) || (child >= &childImages[MAX_CHILD_IMAGES]) || !child->inUse)
+    return EFI_INVALID_PARAMETER;
+
+  mockRun.unloads++;
+  child->inUse = 0;
+  return EFI_SUCCESS;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Variables
+
+static void varPath(char* out, size_t outSize, const CHAR16* name, const EFI_GUID* guid)
+{
+  size_t pos = snprintf(out, outSize, "%s/", mockConfig.varDir);
+  for (; *name && (pos + 1 < outSize); name++) out[pos++] = (char)*name;
+  snprintf(out + pos, outSize - pos, "-%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+           guid->Data1, guid->Data2, guid->Data3, guid->Data4[0], guid->Data4[1],
+           guid->Data4[2], guid->Data4[3], guid->Data4[4], guid->Data4[5], guid->Data4[6], guid->Data4[7]);
+}
+
+static EFI_STATUS EFIAPI mockGetVariable(CHAR16* VariableName, const EFI_GUID* VendorGuid, UINT32* Attributes,
+                                         UINTN* DataSize, VOID* Data)
+{
+  if (!VariableName || !VendorGuid || !DataSize) return EFI_INVALID_PARAMETER;
+  if (mockConfig.variableCostUs) usleep(mockConfig.variableCostUs);
+
+  char path[512];
+  varPath(path, sizeof(path), VariableName, VendorGuid);
+  FILE* varFile = fopen(path, "rb");
+  if (!varFile) return EFI_NOT_FOUND;
+
+  UINT32 attributes;
+  UINT8 buffer[4096];
+  size_t got = fread(&attributes, 1, 4, varFile);
+  if (got == 4) got = fread(buffer, 1, sizeof(buffer), varFile);
+  fclose(varFile);
+  if (got == 0) return EFI_NOT_FOUND;
+
+  if (Attributes) *Attributes = attributes;
+  if ((*DataSize < got) || !Data)
+  {
+    *DataSize = got;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  CopyMem(Data, buffer, got);
+  *DataSize = got;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI mockSetVariable(CHAR16* VariableName, const EFI_GUID* VendorGuid, UINT32 Attributes,
+                                         UINTN DataSize, VOID* Data)
+{
+  if (!VariableName || !VendorGuid) return EFI_INVALID_PARAMETER;
+
+  char path[512];
+  varPath(path, sizeof(path), VariableName, VendorGuid);
+
+  if (!DataSize || !Attributes)
+  {
+    if (remove(path)) return EFI_NOT_FOUND;
+    return EFI_SUCCESS;
+  }
+
+  FILE* varFile = fopen(path, "wb");
+  if (!varFile) return EFI_DEVICE_ERROR;
+  int ok = (fwrite(&Attributes, 4, 1, varFile) == 1) && (fwrite(Data, DataSize, 1, varFile) == 1);
+  fclose(varFile);
+  return ok ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+// -----------------------------------------------------------------------------------------------
+// Tables
+
+static EFI_BOOT_SERVICES bootServices = {
+  .AllocatePool = mockAllocatePool,
+  .FreePool = mockFreePool,
+  .CreateEvent = mockCreateEvent,
+  .SetTimer = mockSetTimer,
+  .WaitForEvent = mockWaitForEvent,
+  .SignalEvent = mockSignalEvent,
+  .CloseEvent = mockCloseEvent,
+  .CheckEvent = mockCheckEvent,
+  .HandleProtocol = mockHandleProtocol,
+  .LocateHandleBuffer = mockLocateHandleBuffer,
+  .LoadImage = mockLoadImage,
+  .StartImage = mockStartImage,
+  .UnloadImage = mockUnloadImage,
+  .Stall = mockStall,
+  .GetNextMonotonicCount = mockGetNextMonotonicCount,
+};
+
+static EFI_RUNTIME_SERVICES runtimeServices = {
+  .GetVariable = mockGetVariable,
+  .SetVariable = mockSetVariable,
+};
+
+EFI_SYSTEM_TABLE mockSystemTable = {
+  .RuntimeServices = &runtimeServices,
+  .BootServices = &bootServices,
+};
+
+// -----------------------------------------------------------------------------------------------
+// Control
+
+int mockInit()
+{
+  loadedImage.DeviceHandle = diskHandle;
+  if (!mockNetInit()) return 0;
+  return 1;
+}
+
+void mockResetRun()
+{
+  mockNetReset();
+  memset(&mockRun, 0, sizeof(mockRun));
+  memset(childImages, 0, sizeof(childImages));
+  monotonicCount = ((monotonicCount >> 32) + 1) << 32;
+  mockStamp(&mockRun.handOff);
+}
+
+void mockShutdown()
+{
+  mockNetShutdown();
+}
+
+static void makeParentDirs(const char* path)
+{
+  char dir[512];
+  snprintf(dir, sizeof(dir), "%s", path);
+  for (char* p = dir + 1; *p; p++)
+  {
+    if (*p != '/') continue;
+    *p = 0;
+    mkdir(dir, 0755);
+    *p = '/';
+  }
+}
+
+// Create Boot#### for a loader at path (an EFI path, e.g. \EFI\GRUB\grubx64.efi)
+// on the mock disk, and an empty file standing in for the loader itself.
+int mockWriteLoadOption(UINT16 number, const char* description, const char* path)
+{
+  UINT8 option[1024];
+  UINTN pos = 0;
+
+  UINT32 attributes = 1; // LOAD_OPTION_ACTIVE
+  CopyMem(&option[pos], &attributes, 4);
+  pos += 4;
+
+  UINTN pathLen = strlen(path);
+  UINTN fileNodeLength = sizeof(EFI_DEVICE_PATH) + ((pathLen + 1) * sizeof(CHAR16));
+  UINT16 filePathListLength = DISK_HD_LENGTH + fileNodeLength + sizeof(EFI_DEVICE_PATH);
+  if (((strlen(description) + 1) * 2) + filePathListLength + 6 > sizeof(option)) return 0;
+
+  CopyMem(&option[pos], &filePathListLength, 2);
+  pos += 2;
+
+  for (const char* c = description; ; c++)
+  {
+    option[pos++] = (UINT8)*c;
+    option[pos++] = 0;
+    if (!*c) break;
+  }
+
+  CopyMem(&option[pos], &diskDevicePath[DISK_HD_OFFSET], DISK_HD_LENGTH);
+  pos += DISK_HD_LENGTH;
+
+  option[pos++] = MEDIA_DEVICE_PATH;
+  option[pos++] = MEDIA_FILEPATH_DP;
+  option[pos++] = fileNodeLength & 0xFF;
+  option[pos++] = fileNodeLength >> 8;
+  for (UINTN i = 0; i <= pathLen; i++)
+  {
+    option[pos++] = (UINT8)path[i];
+    option[pos++] = 0;
+  }
+
+  option[pos++] = END_DEVICE_PATH_TYPE;
+  option[pos++] = END_ENTIRE_DEVICE_PATH_SUBTYPE;
+  option[pos++] = 4;
+  option[pos++] = 0;
+
+  static const EFI_GUID GlobalVariableGUID = EFI_GLOBAL_VARIABLE;
+  CHAR16 name[9];
+  SPrint(name, sizeof(name), L"Boot%04X", number);
+  mkdir(mockConfig.varDir, 0755);
+  if (mockSetVariable(name, &GlobalVariableGUID,
+                      EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
+                      pos, option) != EFI_SUCCESS)
+    return 0;
+
+  CHAR16 widePath[256];
+  UINTN i;
+  for (i = 0; path[i] && (i < 255); i++) widePath[i] = (UINT8)path[i];
+  widePath[i] = 0;
+
+  char loaderPath[512];
+  espPath(loaderPath, sizeof(loaderPath), widePath);
+  makeParentDirs(loaderPath);
+  FILE* loader = fopen(loaderPath, "ab");
+  if (!loader) return 0;
+  fclose(loader);
+  return 1;
+}
+
+// Set BootOrder, e.g. to the entries made with mockWriteLoadOption
+int mockWriteBootOrder(const UINT16* order, UINTN count)
+{
+  static const EFI_GUID GlobalVariableGUID = EFI_GLOBAL_VARIABLE;
+  mkdir(mockConfig.varDir, 0755);
+  return mockSetVariable(L"BootOrder", &GlobalVariableGUID,
+                         EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
+                         count * sizeof(UINT16), (VOID*)order) == EFI_SUCCESS;
+}
@@ -0,0 +1,336 @@
+/*
+
+UEFI Network Boot Switch - host build
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * EFI_SIMPLE_NETWORK on an AF_PACKET socket bound to one interface (one
+ * end of a veth pair, typically). Frames are read from the socket into a
+ * queue where they wait out the injected delay before Receive hands them
+ * over, so Receive behaves like a firmware poll: it never blocks.
+ *
+ * The station accepts frames sent to its own MAC or to broadcast, like the
+ * default receive filter of most firmware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <arpa/inet.h>
+
+#include "efilib.h"
+#include "mock.h"
+
+#define ETHER_HEADER_SIZE 14
+#define MAX_FRAME_SIZE 1514
+#define RX_QUEUE_SIZE 64
+
+typedef struct rx_frame_tt
+{
+  struct timespec release;
+  UINTN length;
+  UINT8 data[MAX_FRAME_SIZE];
+} rx_frame_t;
+
+static int fd = -1;
+static int ifindex = 0;
+static rx_frame_t rxQueue[RX_QUEUE_SIZE];
+static UINTN rxHead = 0;
+static UINTN rxCount = 0;
+
+static EFI_SIMPLE_NETWORK_MODE mode;
+
+static int injectLoss()
+{
+  return mockConfig.lossPercent && ((unsigned int)(random() % 100) < mockConfig.lossPercent);
+}
+
+static void addMs(struct timespec* ts, unsigned int ms)
+{
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (ms % 1000) * 1000000L;
+  if (ts->tv_nsec >= 1000000000L)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+// Move everything waiting on the socket into the rx queue
+static void drainSocket()
+{
+  while(1)
+  {
+    UINT8 buffer[MAX_FRAME_SIZE];
+    struct sockaddr_ll srcAddr;
+    socklen_t srcAddrLen = sizeof(srcAddr);
+    ssize_t got = recvfrom(fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr*)&srcAddr, &srcAddrLen);
+    if (got < 0) return;
+
+    if (srcAddr.sll_pkttype == PACKET_OUTGOING) continue;
+    if (got < ETHER_HEADER_SIZE) continue;
+    if (memcmp(buffer, mode.CurrentAddress.Addr, 6) && memcmp(buffer, mode.BroadcastAddress.Addr, 6)) continue;
+
+    if (injectLoss() || (rxCount == RX_QUEUE_SIZE))
+    {
+      mockRun.framesDropped++;
+      continue;
+    }
+
+    rx_frame_t* frame = &rxQueue[(rxHead + rxCount) % RX_QUEUE_SIZE];
+    mockStamp(&frame->release);
+    addMs(&frame->release, mockConfig.delayMs);
+    if (mockConfig.jitterMs) addMs(&frame->release, random() % (mockConfig.jitterMs + 1));
+    frame->length = got;
+    CopyMem(frame->data, buffer, got);
+    rxCount++;
+  }
+}
+
+int mockNetPacketReady(int* timeoutMs)
+{
+  *timeoutMs = -1;
+  drainSocket();
+  if (!rxCount) return 0;
+
+  struct timespec now;
+  mockStamp(&now);
+  double wait = mockElapsedMs(&now, &rxQueue[rxHead].release);
+  if (wait <= 0) return 1;
+
+  *timeoutMs = (int)wait + 1;
+  return 0;
+}
+
+int mockNetFd()
+{
+  return fd;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+static EFI_STATUS EFIAPI snpStart(EFI_SIMPLE_NETWORK* This)
+{
+  if (mode.State != EfiSimpleNetworkStopped) return EFI_ALREADY_STARTED;
+  mode.State = EfiSimpleNetworkStarted;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI snpStop(EFI_SIMPLE_NETWORK* This)
+{
+  if (mode.State == EfiSimpleNetworkStopped) return EFI_NOT_STARTED;
+  mode.State = EfiSimpleNetworkStopped;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI snpInitialize(EFI_SIMPLE_NETWORK* This, UINTN ExtraRxBufferSize, UINTN ExtraTxBufferSize)
+{
+  if (mode.State != EfiSimpleNetworkStarted) return EFI_NOT_STARTED;
+  mode.State = EfiSimpleNetworkInitialized;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI snpReset(EFI_SIMPLE_NETWORK* This, BOOLEAN ExtendedVerification)
+{
+  if (mode.State != EfiSimpleNetworkInitialized) return EFI_NOT_STARTED;
+  rxCount = 0;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI snpShutdown(EFI_SIMPLE_NETWORK* This)
+{
+  if (mode.State != EfiSimpleNetworkInitialized) return EFI_NOT_STARTED;
+  mode.State = EfiSimpleNetworkStarted;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI snpTransmit(EFI_SIMPLE_NETWORK* This, UINTN HeaderSize, UINTN BufferSize, VOID* Buffer,
+                                     EFI_MAC_ADDRESS* SrcAddr, EFI_MAC_ADDRESS* DestAddr, UINT16* Protocol)
+{
+  if (mode.State != EfiSimpleNetworkInitialized) return EFI_NOT_STARTED;
+  if (!Buffer || (BufferSize > MAX_FRAME_SIZE)) return EFI_INVALID_PARAMETER;
+
+  UINT8* frame = Buffer;
+  if (HeaderSize)
+  {
+    // Fill in the media header as the driver does when HeaderSize is non-zero
+    if ((HeaderSize != ETHER_HEADER_SIZE) || !DestAddr || !Protocol || (BufferSize < HeaderSize))
+      return EFI_INVALID_PARAMETER;
+    CopyMem(&frame[0], DestAddr->Addr, 6);
+    CopyMem(&frame[6], SrcAddr ? SrcAddr->Addr : mode.CurrentAddress.Addr, 6);
+    frame[12] = *Protocol >> 8;
+    frame[13] = *Protocol & 0xFF;
+  }
+
+  if (!mockRun.transmits) mockStamp(&mockRun.firstTransmit);
+  mockRun.transmits++;
+
+  if (injectLoss())
+  {
+    mockRun.framesDropped++;
+    return EFI_SUCCESS;
+  }
+
+  struct sockaddr_ll destAddr;
+  memset(&destAddr, 0, sizeof(destAddr));
+  destAddr.sll_family = AF_PACKET;
+  destAddr.sll_ifindex = ifindex;
+  destAddr.sll_halen = ETH_ALEN;
+  CopyMem(destAddr.sll_addr, frame, 6);
+
+  if (sendto(fd, frame, BufferSize, 0, (struct sockaddr*)&destAddr, sizeof(destAddr)) != (ssize_t)BufferSize)
+    return EFI_DEVICE_ERROR;
+  return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI snpReceive(EFI_SIMPLE_NETWORK* This, UINTN* HeaderSize, UINTN* BufferSize, VOID* Buffer,
+                                    EFI_MAC_ADDRESS* SrcAddr, EFI_MAC_ADDRESS* DestAddr, UINT16* Protocol)
+{
+  if (mode.State != EfiSimpleNetworkInitialized) return EFI_NOT_STARTED;
+  if (!BufferSize || !Buffer) return EFI_INVALID_PARAMETER;
+
+  mockRun.receiveCalls++;
+  if (mockConfig.pollCostUs) usleep(mockConfig.pollCostUs);
+
+  int timeout;
+  if (!mockNetPacketReady(&timeout)) return EFI_NOT_READY;
+
+  rx_frame_t* frame = &rxQueue[rxHead];
+  if (*BufferSize < frame->length)
+  {
+    *BufferSize = frame->length;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  CopyMem(Buffer, frame->data, frame->length);
+  *BufferSize = frame->length;
+  if (HeaderSize) *HeaderSize = ETHER_HEADER_SIZE;
+  if (DestAddr) CopyMem(DestAddr->Addr, &frame->data[0], 6);
+  if (SrcAddr) CopyMem(SrcAddr->Addr, &frame->data[6], 6);
+  UINT16 protocol = (frame->data[12] << 8) | frame->data[13];
+  if (Protocol) *Protocol = protocol;
+
+  if (protocol == 0x88B6)
+  {
+    if (!mockRun.gotReply) mockStamp(&mockRun.firstReply);
+    mockRun.gotReply = 1;
+    // unbs stops receiving once it has a reply, so the last one is the one it took
+    mockStamp(&mockRun.decision);
+  }
+
+  rxHead = (rxHead + 1) % RX_QUEUE_SIZE;
+  rxCount--;
+  return EFI_SUCCESS;
+}
+
+EFI_SIMPLE_NETWORK mockNet = {
+  .Revision = 0x00010000,
+  .Start = snpStart,
+  .Stop = snpStop,
+  .Initialize = snpInitialize,
+  .Reset = snpReset,
+  .Shutdown = snpShutdown,
+  .Transmit = snpTransmit,
+  .Receive = snpReceive,
+  .Mode = &mode,
+};
+
+// -----------------------------------------------------------------------------------------------
+
+int mockNetInit()
+{
+  if (!mockConfig.ifName)
+  {
+    fprintf(stderr, "No network interface given\n");
+    return 0;
+  }
+
+  ifindex = if_nametoindex(mockConfig.ifName);
+  if (!ifindex)
+  {
+    perror(mockConfig.ifName);
+    return 0;
+  }
+
+  fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (fd < 0)
+  {
+    perror("SOCKET");
+    return 0;
+  }
+
+  struct sockaddr_ll bindAddr;
+  memset(&bindAddr, 0, sizeof(bindAddr));
+  bindAddr.sll_family = AF_PACKET;
+  bindAddr.sll_protocol = htons(ETH_P_ALL);
+  bindAddr.sll_ifindex = ifindex;
+  if (bind(fd, (struct sockaddr*)&bindAddr, sizeof(bindAddr)))
+  {
+    perror("BIND");
+    close(fd);
+    fd = -1;
+    return 0;
+  }
+
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  snprintf(ifr.ifr_name, IFNAMSIZ, "%s", mockConfig.ifName);
+  if (ioctl(fd, SIOCGIFHWADDR, &ifr))
+  {
+    perror("SIOCGIFHWADDR");
+    close(fd);
+    fd = -1;
+    return 0;
+  }
+
+  memset(&mode, 0, sizeof(mode));
+  mode.State = EfiSimpleNetworkStopped;
+  mode.HwAddressSize = 6;
+  mode.MediaHeaderSize = ETHER_HEADER_SIZE;
+  mode.MaxPacketSize = 1500;
+  CopyMem(mode.CurrentAddress.Addr, ifr.ifr_hwaddr.sa_data, 6);
+  CopyMem(mode.PermanentAddress.Addr, ifr.ifr_hwaddr.sa_data, 6);
+  memset(mode.BroadcastAddress.Addr, 0xFF, 6);
+  mode.IfType = 1;
+  mode.MediaPresentSupported = 1;
+  mode.MediaPresent = 1;
+
+  mockNet.WaitForPacket = mockCreatePacketEvent();
+  return 1;
+}
+
+// A reboot between runs: interface stopped, anything in flight is lost
+void mockNetReset()
+{
+  mode.State = EfiSimpleNetworkStopped;
+  drainSocket();
+  rxCount = 0;
+}
+
+void mockNetShutdown()
+{
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
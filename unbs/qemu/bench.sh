@@ -0,0 +1,190 @@
+#!/bin/bash
+#
+# Boot unbs.efi under QEMU + OVMF repeatedly and time it. Needs root.
+#
+# A GPT disk image is built holding unbs.efi, server.mac, benchsetup.efi as
+# the removable media loader and two copies of benchtarget.efi. The first
+# boot runs benchsetup, which creates the NVRAM boot entries. Each following
+# boot should go firmware -> unbs -> TARGET1.EFI (entry 2001, which the
+# server hands out). The serial console is timestamped line by line and the
+# time from firmware hand-off to the target starting is reported.
+#
+# QEMU, unbs-server and a tap device all live in their own network
+# namespace. The server answers on the host side of the tap.
+#
+# Environment:
+#   BOOTS         Number of measured boots (default 20)
+#   LOSS          netem loss % on frames to the guest
+#   DELAY         netem delay in ms on frames to the guest
+#   OVMF_CODE     OVMF code image (default /usr/share/OVMF/OVMF_CODE.fd)
+#   OVMF_VARS     OVMF variable store template (default /usr/share/OVMF/OVMF_VARS.fd)
+#   QEMU          QEMU binary (default qemu-system-x86_64)
+#   QEMU_ACCEL    QEMU accelerator (default tcg)
+#   BOOT_TIMEOUT  Seconds before a boot counts as hung (default 180)
+#   LOG_DIR       Keep serial logs here
+#
+# UNVERIFIED: this script, benchsetup.c and benchtarget.c have never been
+# built or run. See "Testing under QEMU" in README.md for what they assume.
+
+set -e
+export LC_ALL=C
+
+HERE=$(cd "$(dirname "$0")/.." && pwd)
+SERVER=$HERE/../unbs-server/unbs-server
+BOOTS=${BOOTS:-20}
+QEMU=${QEMU:-qemu-system-x86_64}
+QEMU_ACCEL=${QEMU_ACCEL:-tcg}
+OVMF_CODE=${OVMF_CODE:-/usr/share/OVMF/OVMF_CODE.fd}
+OVMF_VARS=${OVMF_VARS:-/usr/share/OVMF/OVMF_VARS.fd}
+BOOT_TIMEOUT=${BOOT_TIMEOUT:-180}
+
+NS=unbs-qemu
+TAP=unbs-tap
+GUEST_MAC=52:54:00:b0:07:01
+ENTRY=2001
+
+for tool in "$QEMU" mkfs.fat mmd mcopy sfdisk; do
+  if ! command -v "$tool" > /dev/null; then
+    echo "Missing $tool" >&2
+    exit 1
+  fi
+done
+
+for file in "$OVMF_CODE" "$OVMF_VARS" "$HERE/unbs.efi" "$HERE/qemu/benchsetup.efi" "$HERE/qemu/benchtarget.efi" "$SERVER"; do
+  if [ ! -r "$file" ]; then
+    echo "Missing $file" >&2
+    exit 1
+  fi
+done
+
+WORK=$(mktemp -d)
+LOGS=${LOG_DIR:-$WORK}
+mkdir -p "$LOGS"
+SERVER_PID=
+
+cleanup()
+{
+  [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null || true
+  ip netns del $NS 2>/dev/null || true
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# Network: tap in a namespace, optional netem on the way to the guest
+
+ip netns add $NS
+ip -n $NS link set lo up
+ip -n $NS tuntap add dev $TAP mode tap
+ip -n $NS link set $TAP up
+if [ -n "$LOSS" ] || [ -n "$DELAY" ]; then
+  ip netns exec $NS tc qdisc add dev $TAP root netem ${DELAY:+delay ${DELAY}ms} ${LOSS:+loss ${LOSS}%}
+fi
+SERVER_MAC=$(ip -n $NS link show $TAP | awk '/link\/ether/ { print $2 }')
+
+printf 'Bench guest\n%s\n%s\n' "$GUEST_MAC" "$ENTRY" > "$WORK/unbs-server.db"
+(cd "$WORK" && exec ip netns exec $NS "$SERVER" > server.log) &
+SERVER_PID=$!
+
+# Disk: one 64MB EFI system partition
+
+PART=$WORK/esp.part
+DISK=$WORK/disk.img
+echo "$SERVER_MAC" > "$WORK/server.mac"
+
+mkfs.fat -F 32 -C "$PART" 65536 > /dev/null
+mmd -i "$PART" ::/EFI ::/EFI/BOOT ::/EFI/UNBS ::/EFI/BENCH
+mcopy -i "$PART" "$HERE/unbs.efi" ::/EFI/UNBS/unbs.efi
+mcopy -i "$PART" "$WORK/server.mac" ::/EFI/UNBS/server.mac
+mcopy -i "$PART" "$HERE/qemu/benchsetup.efi" ::/EFI/BOOT/BOOTX64.EFI
+mcopy -i "$PART" "$HERE/qemu/benchtarget.efi" ::/EFI/BENCH/TARGET1.EFI
+mcopy -i "$PART" "$HERE/qemu/benchtarget.efi" ::/EFI/BENCH/TARGET2.EFI
+
+truncate -s 66M "$DISK"
+printf 'label: gpt\nstart=2048, size=131072, type=C12A7328-F81F-11D2-BA4B-00A0C93EC93B\n' | sfdisk -q "$DISK"
+dd if="$PART" of="$DISK" bs=512 seek=2048 conv=notrunc status=none
+
+cp "$OVMF_VARS" "$WORK/vars.fd"
+
+# Boot once, serial console to stdout with a timestamp on each line
+
+stamp()
+{
+  local line
+  while IFS= read -r line; do
+    printf '%s %s\n' "$EPOCHREALTIME" "${line//$'\r'/}"
+  done
+}
+
+boot()
+{
+  echo "$EPOCHREALTIME QEMU-LAUNCH"
+  timeout "$BOOT_TIMEOUT" ip netns exec $NS "$QEMU" \
+    -machine q35 -accel "$QEMU_ACCEL" -m 256 \
+    -drive if=pflash,format=raw,unit=0,readonly=on,file="$OVMF_CODE" \
+    -drive if=pflash,format=raw,unit=1,file="$WORK/vars.fd" \
+    -drive if=none,id=disk0,format=raw,file="$DISK" -device virtio-blk-pci,drive=disk0 \
+    -netdev tap,id=net0,ifname=$TAP,script=no,downscript=no \
+    -device virtio-net-pci,netdev=net0,mac=$GUEST_MAC,romfile= \
+    -display none -monitor none -serial stdio < /dev/null 2>&1 | stamp || true
+}
+
+stampOf() # pattern file
+{
+  grep -a -m1 -- "$1" "$2" | cut -d' ' -f1
+}
+
+boot > "$LOGS/setup.log"
+if ! grep -a -q 'UNBS-BENCH: setup done' "$LOGS/setup.log"; then
+  echo "Setup boot failed, see $LOGS/setup.log" >&2
+  exit 1
+fi
+
+# Measured boots
+
+SUCCESS=0
+FALLBACK=0
+WRONG=0
+HUNG=0
+TIMES=$WORK/times
+
+for i in $(seq 1 "$BOOTS"); do
+  LOG=$LOGS/boot-$i.log
+  boot > "$LOG"
+
+  # Hand-off: OVMF announces starting Boot1000, else the UNBS banner
+  HANDOFF=$(stampOf 'BdsDxe: starting Boot1000' "$LOG")
+  [ -z "$HANDOFF" ] && HANDOFF=$(stampOf 'UEFI Network Boot Switch' "$LOG")
+  TARGET=$(grep -a -m1 'UNBS-BENCH: target started' "$LOG" || true)
+
+  if [ -n "$TARGET" ] && [ -n "$HANDOFF" ]; then
+    if [[ "$TARGET" == *TARGET1.EFI* ]]; then
+      SUCCESS=$((SUCCESS + 1))
+      awk -v a="$HANDOFF" -v b="${TARGET%% *}" 'BEGIN { printf "%.1f\n", (b - a) * 1000 }' >> "$TIMES"
+      RESULT=ok
+    else
+      WRONG=$((WRONG + 1))
+      RESULT="wrong target"
+    fi
+  elif grep -a -q 'UNBS-BENCH: fallback' "$LOG"; then
+    FALLBACK=$((FALLBACK + 1))
+    RESULT=fallback
+  else
+    HUNG=$((HUNG + 1))
+    RESULT=hung
+  fi
+  echo "Boot $i: $RESULT"
+done
+
+echo
+echo "Boots: $BOOTS  Success: $SUCCESS ($(awk -v s=$SUCCESS -v n="$BOOTS" 'BEGIN { printf "%.1f", s * 100 / n }')%)" \
+     " Fallback: $FALLBACK  Wrong target: $WRONG  Hung: $HUNG"
+if [ -s "$TIMES" ]; then
+  sort -n "$TIMES" | awk '
+    { v[NR] = $1; sum += $1 }
+    END {
+      printf "Hand-off -> StartImage     min %8.1f  avg %8.1f  p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f ms\n",
+             v[1], sum / NR, v[int(NR * 0.5) + 1], v[int(NR * 0.9) + 1], v[int(NR * 0.99) + 1], v[NR]
+    }'
+fi
+
+[ "$SUCCESS" -eq "$BOOTS" ]
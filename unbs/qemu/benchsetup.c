@@ -0,0 +1,144 @@
+/*
+
+UEFI Network Boot Switch - QEMU benchmark
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Installed as \EFI\BOOT\BOOTX64.EFI on the benchmark disk.
+ *
+ * First boot (fresh OVMF variables): creates the NVRAM boot entries the
+ * benchmark needs and powers off:
+ *   Boot1000 UNBS           \EFI\UNBS\unbs.efi
+ *   Boot1001 Bench fallback \EFI\BOOT\BOOTX64.EFI (this program)
+ *   Boot2001 Bench target 1 \EFI\BENCH\TARGET1.EFI
+ *   Boot2002 Bench target 2 \EFI\BENCH\TARGET2.EFI
+ *   BootOrder 1000,1001
+ *
+ * Any later boot only gets here if UNBS returned to the firmware, so it
+ * reports a fallback and powers off.
+ *
+ * Entries are written in the short form efibootmgr uses - partition node
+ * then file path - which is what unbs.c expects to find.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+static const EFI_GUID GlobalVariableGUID = EFI_GLOBAL_VARIABLE;
+static const EFI_GUID LoadedImageGUID = LOADED_IMAGE_PROTOCOL;
+
+EFI_STATUS addBootEntry(UINT16 number, EFI_DEVICE_PATH* partNode, CHAR16* description, CHAR16* file);
+void powerOff();
+
+EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
+{
+  InitializeLib(ImageHandle, SystemTable);
+
+  UINTN size = 0;
+  EFI_STATUS status = uefi_call_wrapper(RT->GetVariable, 5,
+                                        L"Boot1000", &GlobalVariableGUID, NULL, &size, NULL);
+  if (status == EFI_BUFFER_TOO_SMALL)
+  {
+    Print(L"UNBS-BENCH: fallback\n");
+    powerOff();
+    return EFI_SUCCESS;
+  }
+
+  EFI_LOADED_IMAGE* efiLI = NULL;
+  status = uefi_call_wrapper(BS->HandleProtocol, 3,
+                             ImageHandle, &LoadedImageGUID, &efiLI);
+  if (status != EFI_SUCCESS)
+  {
+    Print(L"UNBS-BENCH: setup failed, HandleProtocol: %r\n", status);
+    powerOff();
+    return status;
+  }
+
+  // Last node of the device path of our own partition, normally HD(...)
+  EFI_DEVICE_PATH* partNode = DevicePathFromHandle(efiLI->DeviceHandle);
+  while(!IsDevicePathEnd(NextDevicePathNode(partNode)))
+  {
+    partNode = NextDevicePathNode(partNode);
+  }
+
+  status = addBootEntry(0x2001, partNode, L"Bench target 1", L"\\EFI\\BENCH\\TARGET1.EFI");
+  if (status == EFI_SUCCESS)
+    status = addBootEntry(0x2002, partNode, L"Bench target 2", L"\\EFI\\BENCH\\TARGET2.EFI");
+  if (status == EFI_SUCCESS)
+    status = addBootEntry(0x1001, partNode, L"Bench fallback", L"\\EFI\\BOOT\\BOOTX64.EFI");
+  if (status == EFI_SUCCESS) // Boot1000 last - its presence means setup is done
+    status = addBootEntry(0x1000, partNode, L"UNBS", L"\\EFI\\UNBS\\unbs.efi");
+
+  if (status == EFI_SUCCESS)
+  {
+    UINT16 bootOrder[2] = { 0x1000, 0x1001 };
+    status = uefi_call_wrapper(RT->SetVariable, 5,
+                               L"BootOrder", &GlobalVariableGUID,
+                               EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
+                               sizeof(bootOrder), bootOrder);
+  }
+
+  if (status == EFI_SUCCESS)
+    Print(L"UNBS-BENCH: setup done\n");
+  else
+    Print(L"UNBS-BENCH: setup failed: %r\n", status);
+
+  powerOff();
+  return status;
+}
+
+EFI_STATUS addBootEntry(UINT16 number, EFI_DEVICE_PATH* partNode, CHAR16* description, CHAR16* file)
+{
+  // partNode on its own, terminated
+  UINTN partNodeSize = DevicePathNodeLength(partNode);
+  EFI_DEVICE_PATH* partPath = AllocateZeroPool(partNodeSize + END_DEVICE_PATH_LENGTH);
+  CopyMem(partPath, partNode, partNodeSize);
+  SetDevicePathEndNode(NextDevicePathNode(partPath));
+
+  EFI_DEVICE_PATH* filePath = FileDevicePath(NULL, file);
+  EFI_DEVICE_PATH* fullPath = AppendDevicePath(partPath, filePath);
+  FreePool(partPath);
+  FreePool(filePath);
+
+  UINT16 filePathListLength = DevicePathSize(fullPath);
+  UINTN descriptionSize = StrSize(description);
+  UINTN optionSize = 4 + 2 + descriptionSize + filePathListLength;
+  unsigned char* option = AllocateZeroPool(optionSize);
+
+  UINT32 attributes = LOAD_OPTION_ACTIVE;
+  CopyMem(&option[0], &attributes, 4);
+  CopyMem(&option[4], &filePathListLength, 2);
+  CopyMem(&option[6], description, descriptionSize);
+  CopyMem(&option[6 + descriptionSize], fullPath, filePathListLength);
+  FreePool(fullPath);
+
+  CHAR16 name[9];
+  SPrint(name, sizeof(name), L"Boot%04X", number);
+  EFI_STATUS status = uefi_call_wrapper(RT->SetVariable, 5,
+                                        name, &GlobalVariableGUID,
+                                        EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
+                                        optionSize, option);
+  FreePool(option);
+  return status;
+}
+
+void powerOff()
+{
+  uefi_call_wrapper(RT->ResetSystem, 4,
+                    EfiResetShutdown, EFI_SUCCESS, 0, NULL);
+}
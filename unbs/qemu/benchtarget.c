@@ -0,0 +1,46 @@
+/*
+
+UEFI Network Boot Switch - QEMU benchmark
+Copyright (C) 2018 Chris Tallon
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+version 2, as published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+*/
+
+/*
+ * Dummy boot loader for the benchmark disk (\EFI\BENCH\TARGET1.EFI etc.).
+ * Says which file it was started from on the console and powers off.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+static const EFI_GUID LoadedImageGUID = LOADED_IMAGE_PROTOCOL;
+
+EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
+{
+  InitializeLib(ImageHandle, SystemTable);
+
+  EFI_LOADED_IMAGE* efiLI = NULL;
+  EFI_STATUS status = uefi_call_wrapper(BS->HandleProtocol, 3,
+                                        ImageHandle, &LoadedImageGUID, &efiLI);
+  if (status == EFI_SUCCESS)
+    Print(L"UNBS-BENCH: target started %s\n", DevicePathToStr(efiLI->FilePath));
+  else
+    Print(L"UNBS-BENCH: target started (unknown)\n");
+
+  uefi_call_wrapper(RT->ResetSystem, 4,
+                    EfiResetShutdown, EFI_SUCCESS, 0, NULL);
+  return EFI_SUCCESS;
+}
@@ -25,40 +25,200 @@ static const EFI_GUID GlobalVariableGUID = EFI_GLOBAL_VARIABLE;
 static const EFI_GUID SimpleNetworkGUID = EFI_SIMPLE_NETWORK_PROTOCOL;
 static const EFI_GUID SimpleFileSystemGUID = SIMPLE_FILE_SYSTEM_PROTOCOL;
 static const EFI_GUID LoadedImageGUID = LOADED_IMAGE_PROTOCOL;
+static const EFI_GUID UnbsVariableGUID =
+  { 0x3A5C1B7E, 0x0D42, 0x4F6B, {0x9E, 0x21, 0xB0, 0x07, 0xB0, 0x07, 0x55, 0x4E} };
+
+/*
+ * Logging. LOG_LEVEL is fixed at compile time (make LOG=none|error|info|debug)
+ * and calls above it compile to nothing. logTrace is for detail and the hot
+ * path: it records the format string and up to two integer (or static
+ * string) arguments in a ring of TRACE_SIZE entries without formatting
+ * anything, and only prints at LOG=debug. The ring is printed when the boot
+ * fails. UnbsTraceMode bit 0 prints it on every boot and bit 1 saves it as
+ * text to the UnbsTrace variable, readable from the OS through efivarfs.
+ * UnbsTraceMode is read while waiting for the network (prefetch), so a
+ * good boot makes no firmware call for it between reply and StartImage.
+ * make TRACE=0 leaves the ring out.
+ */
+
+#define LOG_NONE  0
+#define LOG_ERROR 1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 128
+#endif
+
+#define TRACE_MODE_PRINT 0x01
+#define TRACE_MODE_SAVE  0x02
+#define TRACE_SAVE_SIZE  4096 // Bytes of text, newest events kept
+
+#if LOG_LEVEL >= LOG_ERROR
+#define logError(...) Print(__VA_ARGS__)
+#else
+#define logError(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_INFO
+#define logInfo(...) Print(__VA_ARGS__)
+#else
+#define logInfo(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define logDebug(...) Print(__VA_ARGS__)
+#else
+#define logDebug(...) ((void)0)
+#endif
+
+#if TRACE_SIZE
+#define traceRecord(...) TRACE_RECORD(__VA_ARGS__, 0, 0, 0)
+#define TRACE_RECORD(format, a, b, ...) traceAdd(format, (UINTN)(a), (UINTN)(b))
+#else
+#define traceRecord(...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define logTrace(...) do { Print(__VA_ARGS__); traceRecord(__VA_ARGS__); } while(0)
+#else
+#define logTrace(...) traceRecord(__VA_ARGS__)
+#endif
 
 EFI_SIMPLE_NETWORK* getNetwork();
-EFI_STATUS transmitRequestPacket(EFI_SIMPLE_NETWORK* net_if_struct);
-EFI_STATUS receivePacket(EFI_SIMPLE_NETWORK* net_if_struct, UINT16* rxBuffer);
+EFI_STATUS transmitRequestPacket(EFI_SIMPLE_NETWORK* net_if_struct, EFI_MAC_ADDRESS* server, UINT32 requestId, UINTN attempt, UINT16* rxBuffer);
+EFI_STATUS receivePacket(EFI_SIMPLE_NETWORK* net_if_struct, UINT32 requestId, UINT16* rxBuffer);
+UINT32 newRequestId();
 char compareMacs(EFI_MAC_ADDRESS m1, EFI_MAC_ADDRESS m2);
+char isServer(EFI_MAC_ADDRESS mac);
 EFI_STATUS getBootEntry(WCHAR* name, UINTN* entrySize, unsigned char** entryData);
 EFI_DEVICE_PATH* getEntryDevicePath(UINTN size, unsigned char* data);
 EFI_DEVICE_PATH* completeDevicePath(EFI_DEVICE_PATH* secondHalfDevicePath);
+EFI_DEVICE_PATH* resolveBootEntry(UINT16 number);
+void prefetch(EFI_HANDLE thisImage, char mayLoad);
+void preloadLastChoice(EFI_HANDLE thisImage);
+EFI_DEVICE_PATH* prefetchEntry(UINT16 number);
+EFI_DEVICE_PATH* takePrefetched(UINT16 number);
+void releasePrefetched();
+UINT16 readLastChoice();
+void saveLastChoice(UINT16 number);
 void sleep(UINTN tenths);
 void d(EFI_STATUS status, const WCHAR* tag);
-char loadServerMAC(EFI_HANDLE ImageHandle);
+void traceAdd(const CHAR16* format, UINTN a, UINTN b);
+void traceDump();
+void traceSave();
+void traceFinish(char failed);
+void readTraceMode();
+char loadServerMACs(EFI_HANDLE ImageHandle);
+char parseMAC(uint8_t* text, EFI_MAC_ADDRESS* mac);
+
+/*
+ * Protocol version 2. Request and reply have the same layout, multi-byte
+ * fields are little endian:
+ *
+ *   0  4  Magic B0 07 B0 07
+ *   4  1  Version (2)
+ *   5  1  Flags: bit 0 set in replies, bits 4-7 attempt number
+ *   6  4  Request ID, copied from request to reply
+ *  10  2  Boot entry (reply), FFFF = no entry for this client
+ *  12  2  Length of load options following the header (reserved, 0)
+ *
+ * Retransmits reuse the request ID so a reply to any of them is accepted,
+ * and the server can answer a retransmit from its cache. The attempt number
+ * is copied to the reply too, to show which transmit was answered.
+ *
+ * Version 1 was just the magic, answered by magic + boot entry. The server
+ * still answers it; this client only accepts version 2 replies.
+ */
 
 static const UINT16 ETHERNET_PROTOCOL = 0x88B6;
-EFI_MAC_ADDRESS serverMAC;
+static const UINT8 PROTOCOL_VERSION = 2;
+#define PROTOCOL_FLAG_REPLY 0x01
+#define PROTOCOL_ATTEMPT_SHIFT 4
+#define PACKET_SIZE 14
+#define MAX_ATTEMPTS 3
+
+/*
+ * server.mac lists one server per line, primary first. The first attempt
+ * goes to the primary alone and to the rest if no reply has come after
+ * HEDGE_DELAY. Later attempts go to all of them. A broadcast or multicast
+ * address can be listed to find any server; then replies are accepted from
+ * any source.
+ *
+ * Each attempt waits RECEIVE_WINDOW for a reply, timed rather than counted
+ * in polls so the hedge always falls inside it however fast a poll is.
+ */
+
+#define MAX_SERVERS 8
+#define HEDGE_DELAY 100000 // 100ns units, 10ms
+#define RECEIVE_WINDOW 2500000 // 100ns units, 250ms
+#define RECEIVE_POLLS 1000 // Only if the window timer can't be created
+
+EFI_MAC_ADDRESS servers[MAX_SERVERS];
+UINTN numServers = 0;
+
+/*
+ * Speculative prefetch. Each receive poll that finds nothing does one step
+ * of the work the reply is likely to need: read BootOrder and the last
+ * choice (UnbsLastChoice, saved after each successful load), resolve the
+ * device path of the last choice and then of every BootOrder entry. When
+ * the reply names the preloaded entry StartImage follows at once;
+ * otherwise its device path is probably resolved already. The variable
+ * reads, file system matching and image load hide behind the network wait.
+ *
+ * LoadImage of the last choice blocks for as long as reading the loader
+ * takes, so it waits until the request has gone to every server - the
+ * hedge mustn't be held up behind it. make PRELOAD=0 leaves it out.
+ */
+
+#define MAX_PREFETCH 32
+
+#ifndef PRELOAD_LAST_CHOICE
+#define PRELOAD_LAST_CHOICE 1
+#endif
+
+typedef struct prefetched_entry_tt
+{
+  UINT16 number;
+  EFI_DEVICE_PATH* devicePath; // NULL if it couldn't be resolved
+} prefetched_entry_t;
+
+prefetched_entry_t prefetched[MAX_PREFETCH];
+UINTN numPrefetched = 0;
+UINTN prefetchStep = 0;
+UINT16* bootOrder = NULL;
+UINTN bootOrderLength = 0;
+UINT16 lastChoice = 0xFFFF;
+EFI_HANDLE preloadedImage = NULL;
+char preloadTried = 0;
 
 EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
 {
   InitializeLib(ImageHandle, SystemTable);
-  Print(L"\n\nUEFI Network Boot Switch\n");
+  logInfo(L"\n\nUEFI Network Boot Switch\n");
 
-  if (loadServerMAC(ImageHandle))
+  if (loadServerMACs(ImageHandle))
   {
-    Print(L"Server MAC: %x:%x:%x:%x:%x:%x\n",
-        serverMAC.Addr[0],
-        serverMAC.Addr[1],
-        serverMAC.Addr[2],
-        serverMAC.Addr[3],
-        serverMAC.Addr[4],
-        serverMAC.Addr[5]);
+    for (UINTN i = 0; i < numServers; i++)
+    {
+      logInfo(L"Server MAC: %x:%x:%x:%x:%x:%x\n",
+          servers[i].Addr[0],
+          servers[i].Addr[1],
+          servers[i].Addr[2],
+          servers[i].Addr[3],
+          servers[i].Addr[4],
+          servers[i].Addr[5]);
+    }
   }
   else
   {
-    Print(L"Could not read server MAC address from file server.mac\n");
-    Print(L"Returning to UEFI loader...\n");
+    logError(L"Could not read server MAC addresses from file server.mac\n");
+    logError(L"Returning to UEFI loader...\n");
+    traceFinish(1);
     sleep(100);
     return EFI_SUCCESS;
   }
@@ -66,7 +226,8 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
   EFI_SIMPLE_NETWORK* net_if_struct = getNetwork();
   if (!net_if_struct)
   {
-    Print(L"Main: No network, returning to UEFI loader\n");
+    logError(L"Main: No network, returning to UEFI loader\n");
+    traceFinish(1);
     return EFI_SUCCESS;
   }
 
@@ -80,7 +241,8 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
     d(status, L"Main: net start");
     if (status != EFI_SUCCESS)
     {
-      Print(L"Main: Could not start network, returning to UEFI loader\n");
+      logError(L"Main: Could not start network, returning to UEFI loader\n");
+      traceFinish(1);
       return EFI_SUCCESS; // FIXME or something else?
     }
 
@@ -96,7 +258,8 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
     d(status, L"Main: net init");
     if (status != EFI_SUCCESS)
     {
-      Print(L"Main: Could not initialise network, returning to UEFI loader\n");
+      logError(L"Main: Could not initialise network, returning to UEFI loader\n");
+      traceFinish(1);
 
       if (doNetworkStop)
       {
@@ -112,30 +275,107 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
   }
 
 
+  EFI_EVENT hedgeTimer = NULL;
+  if (numServers > 1)
+  {
+    status = uefi_call_wrapper(BS->CreateEvent, 5,
+                               EVT_TIMER, 0, NULL, NULL, &hedgeTimer);
+    d(status, L"Main: create hedge timer");
+    if (status != EFI_SUCCESS) hedgeTimer = NULL;
+  }
+
+  EFI_EVENT windowTimer = NULL;
+  status = uefi_call_wrapper(BS->CreateEvent, 5,
+                             EVT_TIMER, 0, NULL, NULL, &windowTimer);
+  d(status, L"Main: create window timer");
+  if (status != EFI_SUCCESS) windowTimer = NULL;
+
   UINT16 rxBuffer = 0xFFFF;
+  UINT32 requestId = newRequestId();
   UINTN txCount = 0;
   while(1)
   {
-    Print(L"Transmit...\n");
     txCount++;
-    transmitRequestPacket(net_if_struct);
+
+    // Without a hedge timer, everyone gets the first attempt too
+    UINTN numSent = ((txCount == 1) && hedgeTimer) ? 1 : numServers;
+    logTrace(L"Transmit request %x attempt %d...\n", requestId, txCount);
+    logTrace(L"Transmit to %d server(s)\n", numSent);
+    status = EFI_NOT_READY;
+    for (UINTN i = 0; (i < numSent) && (status != EFI_SUCCESS); i++)
+      status = transmitRequestPacket(net_if_struct, &servers[i], requestId, txCount, &rxBuffer);
+
+    if (status == EFI_SUCCESS)
+    {
+      logTrace(L"Receive success straight after transmit\n");
+      break;
+    }
+
+    if (numSent < numServers)
+    {
+      status = uefi_call_wrapper(BS->SetTimer, 3,
+                                 hedgeTimer, TimerRelative, HEDGE_DELAY);
+      d(status, L"Main: SetTimer hedge");
+    }
+
+    if (windowTimer)
+    {
+      status = uefi_call_wrapper(BS->SetTimer, 3,
+                                 windowTimer, TimerRelative, RECEIVE_WINDOW);
+      d(status, L"Main: SetTimer window");
+    }
 
     UINTN rxCount = 0; // FIXME Use WaitForPacket when we know how it works
     while(1)
     {
-      status = receivePacket(net_if_struct, &rxBuffer);
+      // A reply to any attempt so far will do
+      status = receivePacket(net_if_struct, requestId, &rxBuffer);
       if (status == EFI_SUCCESS)
       {
-        Print(L"Receive success on iteration: %d\n", rxCount);
+        logTrace(L"Receive success on iteration: %d\n", rxCount);
         break;
       }
-      if (++rxCount == 1000) break;
-      if (status == EFI_NOT_READY) continue;
+
+      if ((numSent < numServers)
+          && (uefi_call_wrapper(BS->CheckEvent, 1, hedgeTimer) == EFI_SUCCESS))
+      {
+        logTrace(L"No reply from primary, hedging on iteration: %d\n", rxCount);
+        for (; (numSent < numServers) && (status != EFI_SUCCESS); numSent++)
+          status = transmitRequestPacket(net_if_struct, &servers[numSent], requestId, txCount, &rxBuffer);
+        if (status == EFI_SUCCESS) break;
+      }
+
+      rxCount++;
+      if (windowTimer ? (uefi_call_wrapper(BS->CheckEvent, 1, windowTimer) == EFI_SUCCESS)
+                      : (rxCount == RECEIVE_POLLS))
+      {
+        logTrace(L"No reply in the window after %d iterations\n", rxCount);
+        break;
+      }
+      if (status == EFI_NOT_READY)
+      {
+        prefetch(ImageHandle, numSent == numServers);
+        continue;
+      }
       d(status, L"Main: receivePacket");
     }
 
     if (status == EFI_SUCCESS) break;
-    if (txCount == 3) break;
+    if (txCount == MAX_ATTEMPTS) break;
+  }
+
+  if (hedgeTimer)
+  {
+    status = uefi_call_wrapper(BS->CloseEvent, 1,
+                               hedgeTimer);
+    d(status, L"Main: CloseEvent hedge");
+  }
+
+  if (windowTimer)
+  {
+    status = uefi_call_wrapper(BS->CloseEvent, 1,
+                               windowTimer);
+    d(status, L"Main: CloseEvent window");
   }
 
   if (doNetworkShutdown)
@@ -155,46 +395,68 @@ EFI_STATUS EFIAPI efi_main(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable
 
   if (rxBuffer == 0xFFFF)
   {
-    Print(L"Main: Net request failed, returning to UEFI loader\n");
+    logError(L"Main: Net request failed, returning to UEFI loader\n");
+    releasePrefetched();
+    traceFinish(1);
     sleep(80);
     return EFI_SUCCESS; // FIXME or something else?
   }
 
-  Print(L"Main: Data received: %4.0x\n", rxBuffer);
-  WCHAR bootName[9];
-  UINTN bootOptionSize = 0;
-  unsigned char* bootOptionData = NULL;
-  SPrint(bootName, 18, L"Boot%4.0x\n", rxBuffer);
-  status = getBootEntry(bootName, &bootOptionSize, &bootOptionData);
-  if (status != EFI_SUCCESS)
+  logInfo(L"Main: Data received: %4.0x\n", rxBuffer);
+
+  EFI_HANDLE childImage = NULL;
+  if (preloadedImage && (lastChoice == rxBuffer))
   {
-    Print(L"Error 2: %r\n", status);
-    Print(L"Main: Could not load boot entry, returning to UEFI loader\n");
-    sleep(80);
-    return EFI_SUCCESS; // FIXME or something else?
+    logInfo(L"Main: Boot%4.0x is already loaded\n", rxBuffer);
+    childImage = preloadedImage;
+    preloadedImage = NULL;
   }
+  else
+  {
+    EFI_DEVICE_PATH* nextBootManagerDevPath = takePrefetched(rxBuffer);
+    if (!nextBootManagerDevPath) nextBootManagerDevPath = resolveBootEntry(rxBuffer);
+    if (!nextBootManagerDevPath)
+    {
+      logError(L"Main: Could not load boot entry, returning to UEFI loader\n");
+      releasePrefetched();
+      traceFinish(1);
+      sleep(80);
+      return EFI_SUCCESS; // FIXME or something else?
+    }
 
-  EFI_DEVICE_PATH* nextBootManagerDevPathHalf = getEntryDevicePath(bootOptionSize, bootOptionData);
-  FreePool(bootOptionData);
-
-  EFI_DEVICE_PATH* nextBootManagerDevPath = completeDevicePath(nextBootManagerDevPathHalf);
-  FreePool(nextBootManagerDevPathHalf);
+    logInfo(L"Final booting: %s\n", DevicePathToStr(nextBootManagerDevPath));
 
-  Print(L"Final booting: %s\n", DevicePathToStr(nextBootManagerDevPath));
+    status = uefi_call_wrapper(SystemTable->BootServices->LoadImage, 6,
+                               TRUE, ImageHandle, nextBootManagerDevPath, NULL, 0, &childImage);
 
-  EFI_HANDLE childImage;
-  status = uefi_call_wrapper(SystemTable->BootServices->LoadImage, 6,
-                             TRUE, ImageHandle, nextBootManagerDevPath, NULL, 0, &childImage);
+    logInfo(L"Main: LoadImage: %r\n", status);
+    traceRecord(L"Main: LoadImage: %r\n", status);
 
-  Print(L"Main: LoadImage: %r\n", status);
+    FreePool(nextBootManagerDevPath);
 
-  FreePool(nextBootManagerDevPath);
+    if (status != EFI_SUCCESS)
+    {
+      if ((status == EFI_SECURITY_VIOLATION) && childImage)
+      {
+        status = uefi_call_wrapper(BS->UnloadImage, 1,
+                                   childImage);
+        d(status, L"Main: UnloadImage");
+      }
+      releasePrefetched();
+      traceFinish(1);
+      sleep(80);
+      return EFI_SUCCESS; // FIXME or something else?
+    }
+  }
 
-  sleep(20);
+  saveLastChoice(rxBuffer);
+  releasePrefetched(); // Unloads a wrong guess
+  traceFinish(0);
 
   status = uefi_call_wrapper(SystemTable->BootServices->StartImage, 3,
                              childImage, NULL, NULL);
-  Print(L"Main: StartImage: %r\n", status);
+  logInfo(L"Main: StartImage: %r\n", status);
+  if (status != EFI_SUCCESS) traceDump();
 
   // FIXME What to clean up if we are returned to?
   return EFI_SUCCESS;
@@ -212,7 +474,7 @@ EFI_SIMPLE_NETWORK* getNetwork()
                                         ByProtocol, &SimpleNetworkGUID, NULL, &numHandles, &handles);
   d(status, L"getNetwork: LocateHandleBuffer");
 
-  Print(L"getNetwork: LocateHandleBuffer OK (%d handles)\n", numHandles);
+  logTrace(L"getNetwork: LocateHandleBuffer OK (%d handles)\n", numHandles);
 
   EFI_HANDLE handle = NULL;
   for (UINTN index = 0; index < numHandles; index++)
@@ -225,7 +487,7 @@ EFI_SIMPLE_NETWORK* getNetwork()
 
   if (!handle)
   {
-    Print(L"getNetwork: No network handle\n");
+    logError(L"getNetwork: No network handle\n");
     return NULL;
   }
 
@@ -236,13 +498,13 @@ EFI_SIMPLE_NETWORK* getNetwork()
   return toReturn;
 }
 
-EFI_STATUS transmitRequestPacket(EFI_SIMPLE_NETWORK* net_if_struct)
+EFI_STATUS transmitRequestPacket(EFI_SIMPLE_NETWORK* net_if_struct, EFI_MAC_ADDRESS* server, UINT32 requestId, UINTN attempt, UINT16* rxBuffer) // EFI_SUCCESS if a reply is in rxBuffer
 {
   void* packet;
   UINTN headerSize = net_if_struct->Mode->MediaHeaderSize;
 
   EFI_STATUS status = uefi_call_wrapper(BS->AllocatePool, 3,
-                             EfiLoaderData, headerSize + 4, &packet);
+                             EfiLoaderData, headerSize + PACKET_SIZE, &packet);
   d(status, L"Transmit: mem alloc");
 
   unsigned char* packetc = (unsigned char*)packet;
@@ -250,59 +512,35 @@ EFI_STATUS transmitRequestPacket(EFI_SIMPLE_NETWORK* net_if_struct)
   packetc[headerSize+1] = 0x07;
   packetc[headerSize+2] = 0xB0;
   packetc[headerSize+3] = 0x07;
+  packetc[headerSize+4] = PROTOCOL_VERSION;
+  packetc[headerSize+5] = (attempt & 0x0F) << PROTOCOL_ATTEMPT_SHIFT;
+  packetc[headerSize+6] = requestId & 0xFF;
+  packetc[headerSize+7] = (requestId >> 8) & 0xFF;
+  packetc[headerSize+8] = (requestId >> 16) & 0xFF;
+  packetc[headerSize+9] = (requestId >> 24) & 0xFF;
+  packetc[headerSize+10] = 0xFF;
+  packetc[headerSize+11] = 0xFF;
+  packetc[headerSize+12] = 0;
+  packetc[headerSize+13] = 0;
 
   status = uefi_call_wrapper(net_if_struct->Transmit, 7,
-                             net_if_struct, headerSize, headerSize + 4, packet, NULL, &serverMAC, &ETHERNET_PROTOCOL);
+                             net_if_struct, headerSize, headerSize + PACKET_SIZE, packet, NULL, server, &ETHERNET_PROTOCOL);
   d(status, L"Transmit: Transmit");
+  FreePool(packet);
+  if (status != EFI_SUCCESS) return status;
 
-
-
-
-  //////////////////////////////////////////////////////////////////
   /*
-   * Major FIXME. Somehow, having this receive attempt here (which fails,
-   * presumably it's too early) allows the receive loop in efi_main
-   * to work after several iterations of the loop. ???
-   * Are there serious timing issues? Is this delaying starting the main
-   * receive loop to just the right time?
-   *
-   * Would prefer to avoid all this and have separate transmit and
-   * receive functions by using the WaitForPacket event in simple
-   * networking, but it doesn't seem to work.
-   * */
-
-  UINTN receivedHeaderSize;
-  UINTN receivedBufferSize = 1024;
-  unsigned char* receivedBuffer = AllocateZeroPool(receivedBufferSize);
-  EFI_MAC_ADDRESS receivedSrcAddress;
-  UINT16 receivedProtocol;
-
-  status = uefi_call_wrapper(net_if_struct->Receive, 7,
-                             net_if_struct, &receivedHeaderSize, &receivedBufferSize, receivedBuffer,
-                             &receivedSrcAddress, NULL, &receivedProtocol);
-
-  Print(L"ReceivePacket: 1 Receive status: %r\n", status);
-/*
-  Print(L"ReceivePacket: 1 Received src MAC: %x:%x:%x:%x:%x:%x\n",
-        receivedSrcAddress.Addr[0],
-        receivedSrcAddress.Addr[1],
-        receivedSrcAddress.Addr[2],
-        receivedSrcAddress.Addr[3],
-        receivedSrcAddress.Addr[4],
-        receivedSrcAddress.Addr[5]);
-*/
-  FreePool(receivedBuffer);
-
-  // FIXME - end of extra receive code
-  //////////////////////////////////////////////////////////////////
-
-
-
-  FreePool(packet);
-  return status;
+   * Receive straight after Transmit. On real firmware this used to be a
+   * Receive whose result was thrown away (it normally failed, presumably
+   * too early), and the receive loop in efi_main only seemed to work with
+   * it there. It stays, but now goes through the same checks as the loop,
+   * so a quick server's reply to this request is kept, not discarded.
+   */
+
+  return receivePacket(net_if_struct, requestId, rxBuffer);
 }
 
-EFI_STATUS receivePacket(EFI_SIMPLE_NETWORK* net_if_struct, UINT16* rxBuffer)
+EFI_STATUS receivePacket(EFI_SIMPLE_NETWORK* net_if_struct, UINT32 requestId, UINT16* rxBuffer)
 {
   UINTN receivedHeaderSize;
   UINTN receivedBufferSize = 1024;
@@ -318,43 +556,46 @@ EFI_STATUS receivePacket(EFI_SIMPLE_NETWORK* net_if_struct, UINT16* rxBuffer)
 
   if (status == EFI_SUCCESS)
   {
-    Print(L"ReceivePacket: Bytes received: %d\n", receivedBufferSize);
-    Print(L"ReceivePacket: Header size: %d\n", receivedHeaderSize);
-    Print(L"ReceivePacket: ReceivedProtocol: %x\n", receivedProtocol);
-    Print(L"ReceivePacket: Received src MAC: %x:%x:%x:%x:%x:%x\n",
-          receivedSrcAddress.Addr[0],
-          receivedSrcAddress.Addr[1],
-          receivedSrcAddress.Addr[2],
-          receivedSrcAddress.Addr[3],
-          receivedSrcAddress.Addr[4],
-          receivedSrcAddress.Addr[5]);
-
-    if ((receivedBufferSize - receivedHeaderSize) < 5)
-      Print(L"ReceivePacket: Packet too short\n");
-
-    if (compareMacs(serverMAC, receivedSrcAddress)) // FIXME receivedSrcAddress is garbage
-      Print(L"ReceivePacket: MAC compare OK\n");
-    else
-      Print(L"ReceivePacket: MAC compare FAIL\n");
-
-    if (receivedProtocol == ETHERNET_PROTOCOL)
-      Print(L"ReceivePacket: protocol OK\n");
+    // SrcAddr from Receive has been garbage, take it from the media header instead
+    ZeroMem(&receivedSrcAddress, sizeof(EFI_MAC_ADDRESS));
+    if (receivedHeaderSize >= 12) CopyMem(receivedSrcAddress.Addr, &receivedBuffer[6], 6);
+
+    logTrace(L"ReceivePacket: %d bytes, protocol %x\n", receivedBufferSize, receivedProtocol);
+    logTrace(L"ReceivePacket: from %06x%06x\n",
+             (receivedSrcAddress.Addr[0] << 16) | (receivedSrcAddress.Addr[1] << 8) | receivedSrcAddress.Addr[2],
+             (receivedSrcAddress.Addr[3] << 16) | (receivedSrcAddress.Addr[4] << 8) | receivedSrcAddress.Addr[5]);
+
+    unsigned char* payload = &receivedBuffer[receivedHeaderSize];
+    UINTN payloadSize = receivedBufferSize - receivedHeaderSize;
+
+    // Anything other than a reply to our request counts as nothing received
+    status = EFI_NOT_READY;
+
+    if (receivedProtocol != ETHERNET_PROTOCOL)
+      logTrace(L"ReceivePacket: protocol FAIL\n");
+    else if (payloadSize < PACKET_SIZE)
+      logTrace(L"ReceivePacket: Packet too short\n");
+    else if (!isServer(receivedSrcAddress))
+      logTrace(L"ReceivePacket: MAC compare FAIL\n");
+    else if (   (payload[0] != 0xB0)
+             || (payload[1] != 0x07)
+             || (payload[2] != 0xB0)
+             || (payload[3] != 0x07) )
+      logTrace(L"ReceivePacket: Magic FAIL\n");
+    else if (payload[4] != PROTOCOL_VERSION)
+      logTrace(L"ReceivePacket: Version FAIL: %d\n", payload[4]);
+    else if (!(payload[5] & PROTOCOL_FLAG_REPLY))
+      logTrace(L"ReceivePacket: Not a reply\n");
+    else if (payloadSize < PACKET_SIZE + (payload[12] | (payload[13] << 8)))
+      logTrace(L"ReceivePacket: Load options truncated\n");
+    else if (requestId != (payload[6] | (payload[7] << 8) | (payload[8] << 16) | ((UINT32)payload[9] << 24)))
+      logTrace(L"ReceivePacket: Request ID FAIL\n");
     else
-      Print(L"ReceivePacket: protocol FAIL\n");
-
-    if (   (receivedBuffer[receivedHeaderSize    ] != 0xB0)
-        || (receivedBuffer[receivedHeaderSize + 1] != 0x07)
-        || (receivedBuffer[receivedHeaderSize + 2] != 0xB0)
-        || (receivedBuffer[receivedHeaderSize + 3] != 0x07) )
-      Print(L"ReceivePacket: Magic FAIL\n");
-    else
-      Print(L"ReceivePacket: Magic OK\n");
-
-    // FIXME implement rejecting based on these checks
-
-    UINT16* payload = (UINT16*)&receivedBuffer[receivedHeaderSize + 4];
-    Print(L"ReceivePacket: Data received: %x\n", *payload);
-    *rxBuffer = *payload;
+    {
+      *rxBuffer = payload[10] | (payload[11] << 8);
+      logTrace(L"ReceivePacket: Reply to attempt %d, data received: %x\n", payload[5] >> PROTOCOL_ATTEMPT_SHIFT, *rxBuffer);
+      status = EFI_SUCCESS;
+    }
   }
 
   FreePool(receivedBuffer);
@@ -365,12 +606,34 @@ char compareMacs(EFI_MAC_ADDRESS m1, EFI_MAC_ADDRESS m2)
 {
   for (int i = 0; i < 6; i++)
   {
-    Print(L"compareMACS: %x %x\n", m1.Addr[i], m2.Addr[i]);
     if (m1.Addr[i] != m2.Addr[i]) return 0;
   }
   return 1;
 }
 
+char isServer(EFI_MAC_ADDRESS mac)
+{
+  for (UINTN i = 0; i < numServers; i++)
+  {
+    if (servers[i].Addr[0] & 0x01) return 1; // Broadcast / multicast listed - anyone may answer
+    if (compareMacs(servers[i], mac)) return 1;
+  }
+  return 0;
+}
+
+UINT32 newRequestId()
+{
+  UINT64 count = 0;
+  EFI_STATUS status = uefi_call_wrapper(BS->GetNextMonotonicCount, 1,
+                                        &count);
+  d(status, L"newRequestId: GetNextMonotonicCount");
+
+  // The high 32 bits of the count go up by one every boot and the low 32
+  // bits every call, so mixing the two keeps IDs from repeating across
+  // boots - a late reply meant for the previous boot won't match.
+  return (UINT32)(((count >> 32) << 16) | (count & 0xFFFF));
+}
+
 EFI_STATUS getBootEntry(WCHAR* name, UINTN* entrySize, unsigned char** entryData) // Caller must Free entryData if EFI_SUCCESS
 {
   UINTN bufferSize = 0;
@@ -396,31 +659,59 @@ EFI_STATUS getBootEntry(WCHAR* name, UINTN* entrySize, unsigned char** entryData
   return EFI_SUCCESS;
 }
 
-EFI_DEVICE_PATH* getEntryDevicePath(UINTN size, unsigned char* data) // Caller must Free data
+EFI_DEVICE_PATH* getEntryDevicePath(UINTN size, unsigned char* data) // Caller must Free data. NULL if malformed
 {
+  // EFI_LOAD_OPTION: 4 bytes attributes, 2 bytes FilePathListLength, NUL
+  // terminated description, FilePathList[]. Any Boot#### can end up here
+  // (PXE, shell, vendor entries) so nothing may be read beyond size.
   UINTN pos = 4; // Skip 4 bytes of attributes
+  if (size < pos + 2) return NULL;
 
   UINT16 filePathListLength;
   CopyMem(&filePathListLength, &data[pos], 2);
   pos += 2;
 
-  UINTN descriptionLengthW = StrLen((WCHAR*)&data[pos]);
+  UINTN descriptionLengthW = 0;
+  while (1)
+  {
+    if (pos + (descriptionLengthW * 2) + 2 > size) return NULL;
+    if (!data[pos + (descriptionLengthW * 2)] && !data[pos + (descriptionLengthW * 2) + 1]) break;
+    descriptionLengthW++;
+  }
+
   WCHAR* description = AllocateZeroPool((descriptionLengthW * 2) + 2);
   CopyMem(description, &data[pos], (descriptionLengthW * 2) + 2);
   pos += (descriptionLengthW * 2) + 2;
-  Print(L"\nBOOTING: description: '%s'\n\n", description);
+  logDebug(L"getEntryDevicePath: description: '%s'\n", description);
   FreePool(description);
 
+  if (pos + filePathListLength > size) return NULL;
+
   unsigned char* filePathList = AllocateZeroPool(filePathListLength);
   CopyMem(filePathList, &data[pos], filePathListLength);
 
-  UINTN dpSize = DevicePathSize((EFI_DEVICE_PATH*)filePathList);
+  // Walk the first path in the list, each node must fit inside it
+  UINTN dpSize = 0;
+  while (1)
+  {
+    EFI_DEVICE_PATH* node = (EFI_DEVICE_PATH*)&filePathList[dpSize];
+    if ((dpSize + sizeof(EFI_DEVICE_PATH) > filePathListLength)
+        || (DevicePathNodeLength(node) < sizeof(EFI_DEVICE_PATH))
+        || (dpSize + DevicePathNodeLength(node) > filePathListLength))
+    {
+      FreePool(filePathList);
+      return NULL;
+    }
+
+    dpSize += DevicePathNodeLength(node);
+    if (IsDevicePathEnd(node)) break;
+  }
 
   EFI_DEVICE_PATH* toReturn = AllocateZeroPool(dpSize);
   CopyMem(toReturn, filePathList, dpSize); // Return only the first FilePathList[]
   FreePool(filePathList);
 
-  Print(L"getEntryDevicePath: Booting: %s\n", DevicePathToStr(toReturn));
+  logDebug(L"getEntryDevicePath: %s\n", DevicePathToStr(toReturn));
   return toReturn;
 }
 
@@ -451,7 +742,8 @@ void d(EFI_STATUS status, const WCHAR* tag)
 {
   if (status != EFI_SUCCESS)
   {
-    Print(L"%s - failed with status: %r\n", tag, status);
+    logError(L"%s - failed with status: %r\n", tag, status);
+    traceRecord(L"%s - failed with status: %r\n", tag, status);
   }
 }
 
@@ -475,6 +767,7 @@ EFI_DEVICE_PATH* completeDevicePath(EFI_DEVICE_PATH* secondHalf) // Caller must
   for (UINTN index = 0; index < numHandles; index++)
   {
     devPath = DevicePathFromHandle(handles[index]);  // Fairly sure we don't FreePool this
+    if (!devPath || IsDevicePathEnd(devPath)) continue;
     partPointer = devPath;
     // partPointer will now be the full EFI_DEVICE_PATH for one of the detected drives, e.g.
     // PciRoot(0)/...etc.../HD(Part1,Sig...etc...)
@@ -485,9 +778,15 @@ EFI_DEVICE_PATH* completeDevicePath(EFI_DEVICE_PATH* secondHalf) // Caller must
       partPointer = NextDevicePathNode(partPointer);
     }
 
-    // secondHalf is a EFI_DEVICE_PATH starting at HD and ending with a EFI boot manager filename
+    // secondHalf is a EFI_DEVICE_PATH starting at HD and ending with a EFI boot manager filename.
+    // Other entries start with something else (VenHw, MAC, ...) and may be shorter than an HD
+    // node, so compare the first node's header before its contents.
 
-    if(LibMatchDevicePaths(partPointer, secondHalf)) // Compares the start of secondHalf to devPath
+    UINTN partNodeLength = DevicePathNodeLength(partPointer);
+    if (   (DevicePathType(secondHalf) == DevicePathType(partPointer))
+        && (DevicePathSubType(secondHalf) == DevicePathSubType(partPointer))
+        && (DevicePathNodeLength(secondHalf) == partNodeLength)
+        && !CompareMem(secondHalf, partPointer, partNodeLength))
     {
       // Match. This is the right drive. Advance secondHalf so it starts at the filesystem path
       secondHalf = NextDevicePathNode(secondHalf);
@@ -500,12 +799,272 @@ EFI_DEVICE_PATH* completeDevicePath(EFI_DEVICE_PATH* secondHalf) // Caller must
   return toReturn;
 }
 
-char loadServerMAC(EFI_HANDLE thisImage)
+EFI_DEVICE_PATH* resolveBootEntry(UINT16 number) // Caller must Free returned EFI_DEVICE_PATH
+{
+  WCHAR bootName[9];
+  UINTN bootOptionSize = 0;
+  unsigned char* bootOptionData = NULL;
+  SPrint(bootName, 18, L"Boot%4.0x", number);
+  EFI_STATUS status = getBootEntry(bootName, &bootOptionSize, &bootOptionData);
+  if (status != EFI_SUCCESS)
+  {
+    logTrace(L"resolveBootEntry: Boot%4.0x: %r\n", number, status);
+    return NULL;
+  }
+
+  EFI_DEVICE_PATH* secondHalf = getEntryDevicePath(bootOptionSize, bootOptionData);
+  FreePool(bootOptionData);
+  if (!secondHalf)
+  {
+    logTrace(L"resolveBootEntry: Boot%4.0x: malformed entry\n", number);
+    return NULL;
+  }
+
+  EFI_DEVICE_PATH* toReturn = completeDevicePath(secondHalf);
+  FreePool(secondHalf);
+
+  if (!toReturn) logTrace(L"resolveBootEntry: Boot%4.0x: no matching partition\n", number);
+  return toReturn;
+}
+
+void prefetch(EFI_HANDLE thisImage, char mayLoad) // One step per call, until there is nothing left to do
+{
+  if (PRELOAD_LAST_CHOICE && mayLoad && (prefetchStep >= 2) && !preloadTried)
+  {
+    preloadTried = 1;
+    preloadLastChoice(thisImage);
+    return;
+  }
+
+  if (prefetchStep == 0)
+  {
+    UINTN size = 0;
+    unsigned char* data = NULL;
+    if (getBootEntry(L"BootOrder", &size, &data) == EFI_SUCCESS)
+    {
+      bootOrder = (UINT16*)data;
+      bootOrderLength = size / 2;
+    }
+    lastChoice = readLastChoice();
+    readTraceMode();
+    logTrace(L"prefetch: %d BootOrder entries, last choice %4.0x\n", bootOrderLength, lastChoice);
+  }
+  else if (prefetchStep == 1)
+  {
+    if (lastChoice != 0xFFFF) prefetchEntry(lastChoice);
+  }
+  else if ((prefetchStep - 2) < bootOrderLength)
+  {
+    prefetchEntry(bootOrder[prefetchStep - 2]);
+  }
+  else
+  {
+    return; // All done
+  }
+
+  prefetchStep++;
+}
+
+void preloadLastChoice(EFI_HANDLE thisImage)
+{
+  if (lastChoice == 0xFFFF) return;
+
+  EFI_DEVICE_PATH* devPath = prefetchEntry(lastChoice); // Resolved in step 1
+  if (!devPath) return;
+
+  EFI_STATUS status = uefi_call_wrapper(BS->LoadImage, 6,
+                                        TRUE, thisImage, devPath, NULL, 0, &preloadedImage);
+  logTrace(L"preloadLastChoice: LoadImage Boot%4.0x: %r\n", lastChoice, status);
+  if (status == EFI_SUCCESS) return;
+
+  // A security violation still leaves an image handle behind
+  if ((status == EFI_SECURITY_VIOLATION) && preloadedImage)
+  {
+    status = uefi_call_wrapper(BS->UnloadImage, 1,
+                               preloadedImage);
+    d(status, L"preloadLastChoice: UnloadImage");
+  }
+  preloadedImage = NULL;
+}
+
+EFI_DEVICE_PATH* prefetchEntry(UINT16 number) // Returned path stays in prefetched[], don't Free
+{
+  for (UINTN i = 0; i < numPrefetched; i++)
+  {
+    if (prefetched[i].number == number) return prefetched[i].devicePath;
+  }
+
+  if (numPrefetched == MAX_PREFETCH) return NULL;
+
+  prefetched[numPrefetched].number = number;
+  prefetched[numPrefetched].devicePath = resolveBootEntry(number);
+  return prefetched[numPrefetched++].devicePath;
+}
+
+EFI_DEVICE_PATH* takePrefetched(UINT16 number) // Caller must Free returned EFI_DEVICE_PATH
+{
+  for (UINTN i = 0; i < numPrefetched; i++)
+  {
+    if (prefetched[i].number != number) continue;
+
+    EFI_DEVICE_PATH* toReturn = prefetched[i].devicePath;
+    prefetched[i].devicePath = NULL;
+    if (toReturn) logTrace(L"takePrefetched: Boot%4.0x was resolved already\n", number);
+    return toReturn;
+  }
+  return NULL;
+}
+
+void releasePrefetched()
+{
+  if (preloadedImage)
+  {
+    EFI_STATUS status = uefi_call_wrapper(BS->UnloadImage, 1,
+                                          preloadedImage);
+    d(status, L"releasePrefetched: UnloadImage");
+    preloadedImage = NULL;
+  }
+
+  for (UINTN i = 0; i < numPrefetched; i++)
+  {
+    if (prefetched[i].devicePath) FreePool(prefetched[i].devicePath);
+  }
+  numPrefetched = 0;
+
+  if (bootOrder) FreePool(bootOrder);
+  bootOrder = NULL;
+  bootOrderLength = 0;
+  prefetchStep = 0;
+  preloadTried = 0;
+  lastChoice = 0xFFFF;
+}
+
+UINT16 readLastChoice()
+{
+  UINT16 number;
+  UINTN size = sizeof(number);
+  EFI_STATUS status = uefi_call_wrapper(RT->GetVariable, 5,
+                                        L"UnbsLastChoice", &UnbsVariableGUID, NULL, &size, &number);
+  if ((status != EFI_SUCCESS) || (size != sizeof(number))) return 0xFFFF;
+  return number;
+}
+
+void saveLastChoice(UINT16 number)
+{
+  if (!prefetchStep) lastChoice = readLastChoice(); // Reply came before prefetch started
+  if (number == lastChoice) return; // Don't wear the flash
+
+  EFI_STATUS status = uefi_call_wrapper(RT->SetVariable, 5,
+                                        L"UnbsLastChoice", &UnbsVariableGUID,
+                                        EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                                        sizeof(number), &number);
+  d(status, L"saveLastChoice: SetVariable");
+}
+
+#if TRACE_SIZE
+typedef struct trace_entry_tt
+{
+  const CHAR16* format;
+  UINTN a;
+  UINTN b;
+} trace_entry_t;
+
+trace_entry_t traceRing[TRACE_SIZE];
+UINTN traceCount = 0; // Events ever recorded, the next goes in traceCount % TRACE_SIZE
+UINT8 traceMode = 0;
+char traceModeRead = 0;
+
+void traceAdd(const CHAR16* format, UINTN a, UINTN b)
+{
+  trace_entry_t* entry = &traceRing[traceCount++ % TRACE_SIZE];
+  entry->format = format;
+  entry->a = a;
+  entry->b = b;
+}
+#endif
+
+void traceDump()
+{
+#if TRACE_SIZE
+  UINTN first = (traceCount > TRACE_SIZE) ? traceCount - TRACE_SIZE : 0;
+  Print(L"Trace, last %d of %d events:\n", traceCount - first, traceCount);
+  for (UINTN i = first; i < traceCount; i++)
+  {
+    trace_entry_t* entry = &traceRing[i % TRACE_SIZE];
+    Print(entry->format, entry->a, entry->b);
+  }
+#endif
+}
+
+void traceSave()
+{
+#if TRACE_SIZE
+  CHAR16 line[128];
+  UINTN first = (traceCount > TRACE_SIZE) ? traceCount - TRACE_SIZE : 0;
+
+  // Newest first, find how many events fit
+  UINTN length = 0;
+  UINTN start = traceCount;
+  while (start > first)
+  {
+    trace_entry_t* entry = &traceRing[(start - 1) % TRACE_SIZE];
+    SPrint(line, sizeof(line), entry->format, entry->a, entry->b);
+    if (length + StrLen(line) > TRACE_SAVE_SIZE) break;
+    length += StrLen(line);
+    start--;
+  }
+
+  // Then write them oldest first, as ASCII
+  CHAR8* text = AllocateZeroPool(TRACE_SAVE_SIZE);
+  UINTN pos = 0;
+  for (UINTN i = start; i < traceCount; i++)
+  {
+    trace_entry_t* entry = &traceRing[i % TRACE_SIZE];
+    SPrint(line, sizeof(line), entry->format, entry->a, entry->b);
+    for (UINTN j = 0; line[j] && (pos < TRACE_SAVE_SIZE); j++) text[pos++] = (CHAR8)line[j];
+  }
+
+  EFI_STATUS status = uefi_call_wrapper(RT->SetVariable, 5,
+                                        L"UnbsTrace", &UnbsVariableGUID,
+                                        EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS,
+                                        pos, text);
+  d(status, L"traceSave: SetVariable");
+  FreePool(text);
+#endif
+}
+
+void readTraceMode()
+{
+#if TRACE_SIZE
+  UINTN size = sizeof(traceMode);
+  EFI_STATUS status = uefi_call_wrapper(RT->GetVariable, 5,
+                                        L"UnbsTraceMode", &UnbsVariableGUID, NULL, &size, &traceMode);
+  if (status != EFI_SUCCESS) traceMode = 0;
+  traceModeRead = 1;
+#endif
+}
+
+void traceFinish(char failed) // Print and / or save the trace, as UnbsTraceMode asks
+{
+#if TRACE_SIZE
+  // Not read yet if the reply came before the first idle poll. Then only a
+  // failed boot, which isn't in a hurry, reads it here.
+  if (!traceModeRead && failed) readTraceMode();
+
+  if (failed || (traceMode & TRACE_MODE_PRINT)) traceDump();
+  if (traceMode & TRACE_MODE_SAVE) traceSave();
+
+  traceMode = 0;
+  traceModeRead = 0;
+#endif
+}
+
+char loadServerMACs(EFI_HANDLE thisImage)
 {
   EFI_LOADED_IMAGE* efiLI = NULL;
   EFI_STATUS status = uefi_call_wrapper(BS->HandleProtocol, 3,
                                  thisImage, &LoadedImageGUID, &efiLI);
-  Print(L"loadServerMAC: HandleProtocol 1: %r\n", status);
+  logTrace(L"loadServerMACs: HandleProtocol 1: %r\n", status);
   if (status != EFI_SUCCESS) return 0;
 
   EFI_HANDLE deviceHandle = efiLI->DeviceHandle;
@@ -513,51 +1072,74 @@ char loadServerMAC(EFI_HANDLE thisImage)
   EFI_FILE_IO_INTERFACE* efiSF = NULL;
   status = uefi_call_wrapper(BS->HandleProtocol, 3,
                                  deviceHandle, &SimpleFileSystemGUID, &efiSF);
-  Print(L"loadServerMAC: HandleProtocol 2: %r\n", status);
+  logTrace(L"loadServerMACs: HandleProtocol 2: %r\n", status);
   if (status != EFI_SUCCESS) return 0;
 
   EFI_FILE* root;
   status = uefi_call_wrapper(efiSF->OpenVolume, 2,
                              efiSF, &root);
-  Print(L"loadServerMAC: OpenVolume: %r\n", status);
+  logTrace(L"loadServerMACs: OpenVolume: %r\n", status);
   if (status != EFI_SUCCESS) return 0;
 
   EFI_FILE* macFile;
   status = uefi_call_wrapper(root->Open, 5,
                              root, &macFile, L"\\EFI\\UNBS\\server.mac", EFI_FILE_MODE_READ, 0);
-  Print(L"loadServerMAC: Open file: %r\n", status);
+  logTrace(L"loadServerMACs: Open file: %r\n", status);
   if (status != EFI_SUCCESS) return 0;
 
-  UINTN dataSize = 17;
-  uint8_t data[17];
+  UINTN dataSize = 1024;
+  uint8_t data[1024];
 
-  for(int j = 0; j < 17; j++) data[j] = 0;
+  for(int j = 0; j < 1024; j++) data[j] = 0;
 
   status = uefi_call_wrapper(macFile->Read, 3,
                              macFile, &dataSize, data);
-  Print(L"loadServerMAC: Read file: %r\n", status);
+  logTrace(L"loadServerMACs: Read file: %r\n", status);
 
   if (uefi_call_wrapper(macFile->Close, 1, macFile) != EFI_SUCCESS)
-    Print(L"FAILED TO CLOSE server.mac !!\n");
+    logError(L"FAILED TO CLOSE server.mac !!\n");
 
   if (status != EFI_SUCCESS) return 0;
 
+  // One MAC at the start of each line. Lines that don't start with one are skipped.
+  numServers = 0;
+  UINTN pos = 0;
+  while ((pos + 17 <= dataSize) && (numServers < MAX_SERVERS))
+  {
+    if (parseMAC(&data[pos], &servers[numServers])) numServers++;
+
+    while ((pos < dataSize) && (data[pos] != '\n')) pos++;
+    pos++;
+  }
+
+  return numServers > 0;
+}
+
+char parseMAC(uint8_t* text, EFI_MAC_ADDRESS* mac) // text must have 17 chars
+{
   uint8_t outpos = 0;
   uint8_t temp;
 
+  ZeroMem(mac, sizeof(EFI_MAC_ADDRESS));
+
   // Convert ASCII MAC to binary. Is there anything like scanf in GNU-EFI?
   for(uint8_t i = 0; i < 17; i++)
   {
-    if ((i == 2) || (i == 5) || (i == 8) || (i == 11) || (i == 14)) continue;
+    if ((i == 2) || (i == 5) || (i == 8) || (i == 11) || (i == 14))
+    {
+      if (text[i] != ':') return 0;
+      continue;
+    }
 
-    if      ((data[i] > 47) && (data[i] <  58)) temp = data[i] - 48;
-    else if ((data[i] > 64) && (data[i] <  71)) temp = data[i] - 55;
-    else if ((data[i] > 96) && (data[i] < 103)) temp = data[i] - 87;
+    if      ((text[i] > 47) && (text[i] <  58)) temp = text[i] - 48;
+    else if ((text[i] > 64) && (text[i] <  71)) temp = text[i] - 55;
+    else if ((text[i] > 96) && (text[i] < 103)) temp = text[i] - 87;
+    else return 0;
 
     if      ((i == 0) || (i == 3) || (i == 6) || (i == 9) || (i == 12) || (i == 15))
-      serverMAC.Addr[outpos] = temp * 0x10;
+      mac->Addr[outpos] = temp * 0x10;
     else if ((i == 1) || (i == 4) || (i == 7) || (i == 10) || (i == 13) || (i == 16))
-      serverMAC.Addr[outpos++] += temp;
+      mac->Addr[outpos++] += temp;
   }
 
   return 1;